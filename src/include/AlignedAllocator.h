@@ -0,0 +1,70 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_ALIGNEDALLOCATOR_H
+#define INC_3DVIEWER_ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/**
+ * @file AlignedAllocator.h - allocator for the mesh arrays
+ */
+
+namespace s21 {
+
+/**
+ * @class AlignedAllocator
+ * @brief places arrays on cache line boundaries and leaves the elements
+ * added by resize(n) uninitialized, they are always overwritten right after
+ */
+template <class T, std::size_t Alignment = 64>
+class AlignedAllocator {
+ public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() noexcept = default;
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+  T *allocate(std::size_t count) {
+    return static_cast<T *>(
+        ::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T *ptr, std::size_t count) noexcept {
+    ::operator delete(ptr, count * sizeof(T), std::align_val_t(Alignment));
+  }
+
+  template <class U>
+  void construct(U *ptr) noexcept {
+    ::new (static_cast<void *>(ptr)) U;
+  }
+
+  template <class U, class... Args>
+  void construct(U *ptr, Args &&...args) {
+    ::new (static_cast<void *>(ptr)) U(std::forward<Args>(args)...);
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return true;
+  }
+
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return false;
+  }
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_ALIGNEDALLOCATOR_H
@@ -0,0 +1,153 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_BLOCKREADER_H
+#define INC_3DVIEWER_BLOCKREADER_H
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AlignedAllocator.h"
+
+/**
+ * @file BlockReader.cc - asynchronous file reader definitions
+ */
+
+namespace s21 {
+
+/**
+ * @class BlockReader
+ * @brief reads a regular file front to back with several large reads in
+ * flight, through io_uring where the kernel allows it and pread otherwise.
+ * The reads land in a ring of page-aligned buffers, so they can bypass the
+ * page cache with O_DIRECT
+ */
+class BlockReader {
+ public:
+  /// how the reads are issued
+  enum class Backend { kPread, kIoUring };
+
+  /// bytes per read, a multiple of any O_DIRECT alignment
+  static constexpr std::size_t kBufferSize = 1 << 21;
+  /// reads in flight
+  static constexpr std::size_t kDepth = 4;
+  /// O_DIRECT offsets and lengths are multiples of it
+  static constexpr std::size_t kDirectAlign = 4096;
+
+  BlockReader();
+  BlockReader(const BlockReader &) = delete;
+  BlockReader &operator=(const BlockReader &) = delete;
+  ~BlockReader();
+
+  /**
+   * @return kIoUring if the running kernel supports its reads, checked once
+   */
+  static Backend Best() noexcept;
+
+  static bool Supported(Backend backend) noexcept;
+
+  /**
+   * Opens the file and starts the first reads
+   * @param backend - must be supported
+   * @param direct - read around the page cache, ignored where the file
+   * system doesn't allow it
+   * @return false if the file is not a regular file or can't be opened
+   */
+  bool Open(const std::string &filename, Backend backend = Best(),
+            bool direct = false) noexcept;
+
+  /**
+   * Waits for the reads in flight and closes the file
+   */
+  void Close() noexcept;
+
+  /**
+   * Copies the next bytes of the file and starts the reads that free up
+   * @return number of bytes written to out, 0 at the end of the file
+   * @throw std::runtime_error if a read fails
+   */
+  std::size_t Read(char *out, std::size_t size);
+
+  [[nodiscard]] bool IsOpen() const noexcept { return fd_ >= 0; }
+  [[nodiscard]] std::size_t size() const noexcept { return size_; }
+  /// bytes returned by Read so far
+  [[nodiscard]] std::size_t Consumed() const noexcept { return consumed_; }
+  [[nodiscard]] Backend backend() const noexcept { return backend_; }
+  /// whether the file is read with O_DIRECT
+  [[nodiscard]] bool direct() const noexcept { return direct_; }
+
+ private:
+  class Ring;
+
+  /**
+   * @struct Slot
+   * @brief buffer of one read, consumed in file order
+   */
+  struct Slot {
+    std::vector<char, AlignedAllocator<char, kDirectAlign>> data;
+    /// file position of data[0]
+    std::size_t offset = 0;
+    /// bytes read so far and bytes the read is after
+    std::size_t filled = 0;
+    std::size_t expected = 0;
+    /// bytes already copied out by Read
+    std::size_t taken = 0;
+    bool pending = false;
+    bool active = false;
+  };
+
+  /**
+   * Starts reading the next part of the file into a slot
+   * @return false at the end of the file
+   */
+  bool Start(Slot &slot);
+
+  /**
+   * Issues the read of the rest of a slot
+   */
+  void Submit(std::size_t index);
+
+  /**
+   * Waits until a slot holds everything it is after, with pread the slot is
+   * read here
+   */
+  void Wait(std::size_t index);
+
+  /**
+   * Reads with pread until size bytes or the end of the file. With O_DIRECT
+   * a short read is continued from its last whole page
+   * @return bytes read, sets error_ if a read fails
+   */
+  std::size_t Fill(char *data, std::size_t size, std::size_t offset);
+
+  /**
+   * @throw std::runtime_error if a read has failed
+   */
+  void CheckError() const;
+
+  /**
+   * Accounts a finished read of a slot, an incomplete one is issued again.
+   * With O_DIRECT the rest can't start mid-page and is read with Fill
+   * @param result - bytes read or a negative errno
+   */
+  void Finish(std::size_t index, long result);
+
+  std::unique_ptr<Ring> ring_;
+  std::array<Slot, kDepth> slots_;
+  std::size_t current_ = 0;
+  std::size_t next_offset_ = 0;
+  std::size_t size_ = 0;
+  std::size_t consumed_ = 0;
+  int fd_ = -1;
+  int error_ = 0;
+  Backend backend_ = Backend::kPread;
+  bool direct_ = false;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_BLOCKREADER_H
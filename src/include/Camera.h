@@ -0,0 +1,71 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_CAMERA_H
+#define INC_3DVIEWER_CAMERA_H
+
+#include <cmath>
+
+#include "Mat4.h"
+#include "Mat4Expr.h"
+#include "Pose.h"
+
+/**
+ * @file Camera.h - projection and view the model is drawn through
+ */
+
+namespace s21 {
+
+/**
+ * @class Camera
+ * @brief projection and view of the widget. The projection is rebuilt only
+ * when its kind or aspect changes, so a frame only evaluates the MVP and
+ * allocates nothing
+ */
+class Camera {
+ public:
+  /// moves the model away from the eye
+  static constexpr Mat4 kView{
+      {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -1.0f, 1}};
+  /// vertical field of view of the perspective projection
+  static constexpr float kFov = float(60.0 * M_PI / 180);
+
+  /**
+   * @param parallel - orthographic projection if set, perspective otherwise
+   * @param aspect - aspect of the perspective projection
+   */
+  void SetProjection(bool parallel, float aspect) noexcept {
+    if (built_ && parallel == parallel_ && aspect == aspect_) return;
+    built_ = true;
+    parallel_ = parallel;
+    aspect_ = aspect;
+    projection_ = parallel ? Mat4::Ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f,
+                                         100.0f)
+                           : Mat4::Perspective(kFov, aspect, 1, 100.0f);
+  }
+
+  [[nodiscard]] const Mat4 &GetProjection() const noexcept {
+    return projection_;
+  }
+
+  /**
+   * @return projection, view and model matrix of pose in the column vector
+   * layout the shaders take, computed in a single pass
+   */
+  [[nodiscard]] Mat4 Mvp(const Pose &pose) const noexcept {
+    const Mat4 model = pose.ToMat4();
+    return Evaluate(Lazy(projection_).Transpose() * Lazy(kView).Transpose() *
+                    Lazy(model));
+  }
+
+ private:
+  Mat4 projection_ = Mat4::Identity();
+  float aspect_ = 0;
+  bool parallel_ = false;
+  bool built_ = false;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_CAMERA_H
@@ -0,0 +1,82 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_DECOMPRESSOR_H
+#define INC_3DVIEWER_DECOMPRESSOR_H
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @file Decompressor.cc - streaming decompressors definitions
+ */
+
+namespace s21 {
+
+/**
+ * @class Decompressor
+ * @brief Streams decompressed data out of a compressed input stream
+ */
+class Decompressor {
+ public:
+  /**
+   * @enum Format
+   * @brief supported input formats
+   */
+  enum class Format { kPlain, kGzip, kZstd };
+
+  /**
+   * Detects the format by magic bytes
+   * @param data - first bytes of the file
+   * @param size - number of bytes available, 4 are enough
+   */
+  static Format Detect(const char *data, std::size_t size) noexcept;
+
+  /**
+   * Detects the format by file name, for streams that can't be rewound
+   */
+  static Format Detect(const std::string &filename) noexcept;
+
+  /**
+   * Creates a decompressor reading from in
+   * @throw std::runtime_error if the format isn't compiled in
+   */
+  static std::unique_ptr<Decompressor> Create(Format format, std::istream &in);
+
+  virtual ~Decompressor() = default;
+
+  /**
+   * Fills out with up to size decompressed bytes
+   * @return number of bytes written, 0 at the end of the data
+   * @throw std::runtime_error on corrupted or truncated data
+   */
+  virtual std::size_t Read(char *out, std::size_t size) = 0;
+
+  /**
+   * @return compressed bytes consumed so far
+   */
+  [[nodiscard]] std::size_t Consumed() const noexcept { return consumed_; }
+
+ protected:
+  explicit Decompressor(std::istream &in) : in_(in), input_(kInputSize) {}
+
+  /**
+   * Reads the next piece of compressed input
+   * @return number of bytes read into input_, 0 at the end of the file
+   */
+  std::size_t Fill();
+
+  static constexpr std::size_t kInputSize = 1 << 20;
+
+  std::istream &in_;
+  std::vector<char> input_;
+  std::size_t consumed_ = 0;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_DECOMPRESSOR_H
@@ -0,0 +1,67 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_MAPPEDFILE_H
+#define INC_3DVIEWER_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @file MappedFile.cc - read-only file mapping definitions
+ */
+
+namespace s21 {
+
+/**
+ * @class MappedFile
+ * @brief RAII read-only mapping of a whole regular file
+ */
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  /**
+   * Maps the file for sequential reading
+   * @param filename - file to map
+   * @param min_size - smaller files are not worth mapping
+   * @param huge_pages - ask the kernel to back the mapping with huge pages
+   * @return false if the file is not a regular file, is too small or can't be
+   * mapped, the caller is expected to fall back to buffered reads
+   */
+  bool Map(const std::string &filename, std::size_t min_size = 1,
+           bool huge_pages = false) noexcept;
+
+  void Unmap() noexcept;
+
+  /**
+   * Drops already parsed pages from the process, they stay in page cache
+   * @param upto - everything before this position is no longer needed
+   */
+  void Release(const char *upto) noexcept;
+
+  /**
+   * Drops pages like Release but keeps them readable for a later pass, for
+   * scans that read ahead of the parser
+   * @param upto - everything before this position may be dropped
+   */
+  void Evict(const char *upto) noexcept;
+
+  [[nodiscard]] bool IsMapped() const noexcept { return data_ != nullptr; }
+  [[nodiscard]] const char *begin() const noexcept { return data_; }
+  [[nodiscard]] const char *end() const noexcept { return data_ + size_; }
+  [[nodiscard]] std::size_t size() const noexcept { return size_; }
+
+ private:
+  const char *data_ = nullptr;
+  const char *released_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_MAPPEDFILE_H
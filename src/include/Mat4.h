@@ -0,0 +1,209 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_MAT4_H
+#define INC_3DVIEWER_MAT4_H
+
+#include <cmath>
+#include <stdexcept>
+
+#include "s21_matrix_oop.h"
+
+/**
+ * @file Mat4.h - fixed-size 4x4 matrix and 4-vector
+ */
+
+namespace s21 {
+
+/**
+ * @struct Vec4
+ * @brief 4 floats aligned for a single SIMD load
+ */
+struct alignas(16) Vec4 {
+  float v[4]{};
+
+  constexpr float &operator[](int i) noexcept { return v[i]; }
+  constexpr float operator[](int i) const noexcept { return v[i]; }
+
+  constexpr bool operator==(const Vec4 &other) const noexcept {
+    return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2] &&
+           v[3] == other.v[3];
+  }
+  constexpr bool operator!=(const Vec4 &other) const noexcept {
+    return !(*this == other);
+  }
+};
+
+/**
+ * @class Mat4
+ * @brief 4x4 float matrix on the stack, stored row after row like S21Matrix
+ * so its 16 floats can be passed wherever a 4x4 S21Matrix's were. Element
+ * access is unchecked and every operation is constexpr
+ */
+class alignas(16) Mat4 {
+ public:
+  /**
+   * Zero matrix
+   */
+  constexpr Mat4() noexcept = default;
+
+  /**
+   * @param values - 16 floats row after row
+   */
+  constexpr explicit Mat4(const float (&values)[16]) noexcept {
+    for (int i = 0; i < 16; ++i) m_[i] = values[i];
+  }
+
+  static constexpr Mat4 Identity() noexcept {
+    Mat4 result;
+    for (int i = 0; i < 4; ++i) result(i, i) = 1;
+    return result;
+  }
+
+  /**
+   * Copies 16 floats row after row, from memory of any alignment
+   */
+  static constexpr Mat4 FromArray(const float *values) noexcept {
+    Mat4 result;
+    for (int i = 0; i < 16; ++i) result.m_[i] = values[i];
+    return result;
+  }
+
+  /**
+   * @throw std::invalid_argument unless matrix is 4x4
+   */
+  static Mat4 FromMatrix(const S21Matrix &matrix) {
+    if (matrix.GetRows() != 4 || matrix.GetCols() != 4) {
+      throw std::invalid_argument("Incorrect input, matrix is not 4x4");
+    }
+    return FromArray(matrix.GetPointer());
+  }
+
+  [[nodiscard]] S21Matrix ToMatrix() const {
+    S21Matrix result(4, 4);
+    Store(result.GetPointer());
+    return result;
+  }
+
+  /**
+   * Copies the 16 floats to memory of any alignment
+   */
+  constexpr void Store(float *out) const noexcept {
+    for (int i = 0; i < 16; ++i) out[i] = m_[i];
+  }
+
+  /// diagonal scaling of x, y and z
+  static constexpr Mat4 Scale(float factor) noexcept {
+    Mat4 result;
+    result(0, 0) = result(1, 1) = result(2, 2) = factor;
+    result(3, 3) = 1;
+    return result;
+  }
+
+  /// translation in the last row, as a row vector times the matrix moves it
+  static constexpr Mat4 Translate(float x, float y, float z) noexcept {
+    Mat4 result = Identity();
+    result(3, 0) = x;
+    result(3, 1) = y;
+    result(3, 2) = z;
+    return result;
+  }
+
+  static constexpr Mat4 Ortho(float left, float right, float bottom,
+                              float top, float near, float far) noexcept {
+    Mat4 result = Identity();
+    result(0, 0) = 2.0f / (right - left);
+    result(1, 1) = 2.0f / (top - bottom);
+    result(2, 2) = -2.0f / (far - near);
+    result(3, 0) = -(right + left) / (right - left);
+    result(3, 1) = -(top + bottom) / (top - bottom);
+    result(3, 2) = -(far + near) / (far - near);
+    return result;
+  }
+
+  /**
+   * Not constexpr, tangents are not
+   * @param fov - vertical field of view in radians
+   */
+  static Mat4 Perspective(float fov, float aspect, float near,
+                          float far) noexcept {
+    Mat4 result = Identity();
+    result(0, 0) = 1 / (aspect * std::tan(fov / 2));
+    result(1, 1) = 1 / std::tan(fov / 2);
+    result(2, 2) = far / (near - far);
+    result(2, 3) = -1.0f;
+    result(3, 2) = -(2 * far * near) / (far - near);
+    return result;
+  }
+
+  constexpr float &operator()(int row, int col) noexcept {
+    return m_[row * 4 + col];
+  }
+  constexpr float operator()(int row, int col) const noexcept {
+    return m_[row * 4 + col];
+  }
+
+  /**
+   * Sums in the order S21Matrix::MulMatrix does, so the products are equal
+   */
+  constexpr Mat4 operator*(const Mat4 &other) const noexcept {
+    Mat4 result;
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        float sum = 0;
+        for (int k = 0; k < 4; ++k) sum += (*this)(i, k) * other(k, j);
+        result(i, j) = sum;
+      }
+    }
+    return result;
+  }
+
+  constexpr Mat4 &operator*=(const Mat4 &other) noexcept {
+    return *this = *this * other;
+  }
+
+  [[nodiscard]] constexpr Mat4 Transpose() const noexcept {
+    Mat4 result;
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) result(i, j) = (*this)(j, i);
+    }
+    return result;
+  }
+
+  constexpr bool operator==(const Mat4 &other) const noexcept {
+    for (int i = 0; i < 16; ++i) {
+      if (m_[i] != other.m_[i]) return false;
+    }
+    return true;
+  }
+  constexpr bool operator!=(const Mat4 &other) const noexcept {
+    return !(*this == other);
+  }
+
+  [[nodiscard]] constexpr const float *GetPointer() const noexcept {
+    return m_;
+  }
+  constexpr float *GetPointer() noexcept { return m_; }
+
+ private:
+  float m_[16]{};
+};
+
+/**
+ * Row vector times matrix, the way the shaders apply the uploaded matrix to
+ * a position
+ */
+constexpr Vec4 operator*(const Vec4 &vec, const Mat4 &mat) noexcept {
+  Vec4 result;
+  for (int j = 0; j < 4; ++j) {
+    float sum = 0;
+    for (int k = 0; k < 4; ++k) sum += vec[k] * mat(k, j);
+    result[j] = sum;
+  }
+  return result;
+}
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_MAT4_H
@@ -0,0 +1,115 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_MAT4EXPR_H
+#define INC_3DVIEWER_MAT4EXPR_H
+
+#include <cstddef>
+#include <type_traits>
+
+#include "Mat4.h"
+#include "Mat4Kernels.h"
+
+/**
+ * @file Mat4Expr.h - lazy products and transposes of Mat4
+ */
+
+namespace s21 {
+
+/**
+ * @class Mat4Ref
+ * @brief leaf of a lazy expression, a Mat4 read as is or transposed. Holds
+ * a reference, so an expression is evaluated in the statement that builds
+ * it
+ */
+template <bool kTransposed>
+class Mat4Ref {
+ public:
+  /// number of factors in the chain
+  static constexpr std::size_t kLinks = 1;
+
+  constexpr explicit Mat4Ref(const Mat4 &matrix) noexcept : matrix_(matrix) {}
+
+  [[nodiscard]] constexpr Mat4Ref<!kTransposed> Transpose() const noexcept {
+    return Mat4Ref<!kTransposed>(matrix_);
+  }
+
+  /**
+   * Writes the factors left to right
+   */
+  constexpr void Flatten(Mat4Link *out) const noexcept {
+    *out = {&matrix_, kTransposed};
+  }
+
+ private:
+  const Mat4 &matrix_;
+};
+
+/**
+ * @class Mat4Product
+ * @brief lazy l * r, nothing is multiplied until Evaluate
+ */
+template <class L, class R>
+class Mat4Product {
+ public:
+  static constexpr std::size_t kLinks = L::kLinks + R::kLinks;
+
+  constexpr Mat4Product(const L &l, const R &r) noexcept : l_(l), r_(r) {}
+
+  /**
+   * (l * r)^T is r^T * l^T, so transposes end up on the leaves
+   */
+  [[nodiscard]] constexpr auto Transpose() const noexcept {
+    using Left = decltype(r_.Transpose());
+    using Right = decltype(l_.Transpose());
+    return Mat4Product<Left, Right>(r_.Transpose(), l_.Transpose());
+  }
+
+  constexpr void Flatten(Mat4Link *out) const noexcept {
+    l_.Flatten(out);
+    r_.Flatten(out + L::kLinks);
+  }
+
+ private:
+  L l_;
+  R r_;
+};
+
+template <class T>
+struct IsMat4Expr : std::false_type {};
+template <bool kTransposed>
+struct IsMat4Expr<Mat4Ref<kTransposed>> : std::true_type {};
+template <class L, class R>
+struct IsMat4Expr<Mat4Product<L, R>> : std::true_type {};
+
+/**
+ * Starts a lazy expression, such as
+ * Evaluate(Lazy(a).Transpose() * Lazy(b))
+ */
+constexpr Mat4Ref<false> Lazy(const Mat4 &matrix) noexcept {
+  return Mat4Ref<false>(matrix);
+}
+
+template <class L, class R,
+          class = std::enable_if_t<IsMat4Expr<L>::value &&
+                                   IsMat4Expr<R>::value>>
+constexpr Mat4Product<L, R> operator*(const L &l, const R &r) noexcept {
+  return Mat4Product<L, R>(l, r);
+}
+
+/**
+ * Computes the expression in a single Mat4Kernels::Chain pass, with no
+ * partial products in memory and nothing allocated
+ */
+template <class E, class = std::enable_if_t<IsMat4Expr<E>::value>>
+Mat4 Evaluate(const E &expr,
+              Mat4Kernels::Isa isa = Mat4Kernels::Best()) noexcept {
+  Mat4Link links[E::kLinks];
+  expr.Flatten(links);
+  return Mat4Kernels::Chain(links, E::kLinks, isa);
+}
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_MAT4EXPR_H
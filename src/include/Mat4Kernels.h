@@ -0,0 +1,84 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_MAT4KERNELS_H
+#define INC_3DVIEWER_MAT4KERNELS_H
+
+#include <cstddef>
+
+#include "Mat4.h"
+
+/**
+ * @file Mat4Kernels.cc - vectorized Mat4 operations definitions
+ */
+
+namespace s21 {
+
+/**
+ * @struct Mat4Link
+ * @brief one factor of a product chain, read transposed if asked
+ */
+struct Mat4Link {
+  const Mat4 *matrix;
+  bool transposed;
+};
+
+/**
+ * @class Mat4Kernels
+ * @brief Mat4 operations with a kernel per instruction set, picked at run
+ * time. kScalar is the reference the others are tested against
+ */
+class Mat4Kernels {
+ public:
+  /// instruction sets the kernels are written for
+  enum class Isa { kScalar, kSse, kAvx, kNeon };
+
+  /**
+   * @return the widest instruction set the running CPU supports, checked
+   * once
+   */
+  static Isa Best() noexcept;
+
+  /**
+   * @return whether this build and the running CPU support isa
+   */
+  static bool Supported(Isa isa) noexcept;
+
+  /**
+   * @return a * b, isa must be supported
+   */
+  static Mat4 Multiply(const Mat4 &a, const Mat4 &b,
+                       Isa isa = Best()) noexcept;
+
+  static Mat4 Transpose(const Mat4 &m, Isa isa = Best()) noexcept;
+
+  /**
+   * Inverts an affine transform of row vectors: a 3x3 linear part and a
+   * translation in the last row, the last column is 0 0 0 1
+   * @param out - set to the inverse, untouched if the linear part is
+   * singular
+   * @return false if it is
+   */
+  static bool AffineInverse(const Mat4 &m, Mat4 &out,
+                            Isa isa = Best()) noexcept;
+
+  /**
+   * Multiplies count factors left to right in registers, transposing each
+   * as it is loaded, without storing the partial products. Rounds like
+   * multiplying the transposed copies one after another
+   * @param count - at least 1
+   */
+  static Mat4 Chain(const Mat4Link *links, std::size_t count,
+                    Isa isa = Best()) noexcept;
+
+  /**
+   * Multiplies count row vectors by m, in may be out
+   */
+  static void Transform(const Mat4 &m, const Vec4 *in, Vec4 *out,
+                        std::size_t count, Isa isa = Best()) noexcept;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_MAT4KERNELS_H
@@ -0,0 +1,119 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_MESHCACHE_H
+#define INC_3DVIEWER_MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @file MeshCache.cc - binary mesh cache definitions
+ */
+
+namespace s21 {
+
+struct Obj;
+
+/**
+ * @class MeshCache
+ * @brief Binary copies of parsed models, reopened without parsing
+ * @details One cache file per source path, named after the path hash. The
+ * file is a Header followed by the vertex array, the index array and the
+ * groups, all optionally deflated. An entry is valid while the source keeps
+ * its size, mtime and content hash.
+ */
+class MeshCache {
+ public:
+  /// bumped on every change of the file layout, older files are ignored
+  static constexpr std::uint32_t kVersion = 5;
+
+  /**
+   * @struct Header
+   * @brief layout of the cache file header
+   */
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint32_t reserved;
+    std::uint64_t variant;
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    std::uint64_t source_hash;
+    std::uint64_t vertex_count;
+    std::uint64_t index_count;
+    std::uint64_t payload_size;
+    std::uint64_t welded;
+    float lower[3];
+    float upper[3];
+    float radius;
+    std::uint32_t padding;
+    /// size of the serialized groups that follow the index array
+    std::uint64_t group_bytes;
+  };
+
+  /// Header::flags bit for a deflated payload
+  static constexpr std::uint32_t kCompressed = 1;
+
+  /**
+   * Ctor
+   * @param dir - cache directory, empty means $XDG_CACHE_HOME/3dViewer or
+   * ~/.cache/3dViewer
+   * @param limit - total size of cache files, least recently used are removed
+   * @param compress - deflate stored arrays
+   * @param variant - load options that change the result, entries are only
+   * used by loads with the same variant
+   */
+  MeshCache(std::string dir, std::uintmax_t limit, bool compress,
+            std::uint64_t variant = 0);
+
+  /**
+   * Fills result from the cache entry of filename. A damaged entry counts
+   * as missing, whatever it throws
+   * @return false if there is no valid entry, result is left untouched
+   */
+  bool Load(const std::string &filename, Obj &result) noexcept;
+
+  /**
+   * Writes result as the cache entry of filename and evicts old entries,
+   * failures are ignored since the cache is only an optimization
+   */
+  void Store(const std::string &filename, const Obj &result) noexcept;
+
+  /**
+   * Content hash used for cache keys, 64 bit, runs at memory bandwidth
+   */
+  static std::uint64_t Hash(const char *data, std::size_t size) noexcept;
+
+ private:
+  /**
+   * Fills source size and mtime of filename, and its hash if asked, into
+   * source_. Each value is computed once per MeshCache.
+   * @return false for anything but a readable regular file
+   */
+  bool Describe(const std::string &filename, bool with_hash);
+
+  /**
+   * Load without the exception guard
+   */
+  bool LoadEntry(const std::string &filename, Obj &result);
+
+  std::string EntryPath(const std::string &filename) const;
+
+  void Evict() noexcept;
+
+ private:
+  std::string dir_;
+  std::uintmax_t limit_;
+  bool compress_;
+  std::uint64_t variant_;
+  Header source_{};
+  bool described_ = false;
+  bool hashed_ = false;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_MESHCACHE_H
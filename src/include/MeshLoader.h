@@ -0,0 +1,85 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_MESHLOADER_H
+#define INC_3DVIEWER_MESHLOADER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * @file MeshLoader.cc - binary mesh loaders definitions
+ */
+
+namespace s21 {
+
+struct Obj;
+
+/**
+ * @class MeshLoader
+ * @brief reads a mesh format other than OBJ into Obj's arrays. Loaders are
+ * kept in a registry and picked by file name and magic bytes, files no
+ * loader accepts are parsed as OBJ text by OpenFileCommand
+ */
+class MeshLoader {
+ public:
+  /// bytes of the file head passed to Accepts
+  static constexpr std::size_t kProbeSize = 512;
+
+  virtual ~MeshLoader() = default;
+
+  /**
+   * @return short name of the format, such as "STL"
+   */
+  [[nodiscard]] virtual const char *Name() const noexcept = 0;
+
+  /**
+   * @param filename - for the extension
+   * @param head - first bytes of the file, may be empty for streams
+   * @param size - number of bytes in head, at most kProbeSize
+   * @param file_size - size of the whole file, 0 if unknown
+   * @return whether the file is in this loader's format
+   */
+  [[nodiscard]] virtual bool Accepts(const std::string &filename,
+                                     const char *head, std::size_t size,
+                                     std::size_t file_size) const noexcept = 0;
+
+  /**
+   * Sets result's vertexes to x, y, z triples and its facetes to the edges
+   * of every polygon as pairs of 1-based indices, as OpenFileCommand parses
+   * an OBJ. Every index addresses a vertex
+   * @param data - whole file
+   * @throw std::runtime_error if the data is malformed or the variant of the
+   * format is not supported
+   */
+  virtual void Load(const char *data, std::size_t size, Obj &result) const = 0;
+
+  /**
+   * @return whether the format stores a shared vertex once per face, such
+   * meshes are always welded
+   */
+  [[nodiscard]] virtual bool Welds() const noexcept { return false; }
+
+  /**
+   * Adds a loader, asked after the ones added before it. Binary STL and
+   * little-endian PLY are built in
+   */
+  static void Register(std::unique_ptr<MeshLoader> loader);
+
+  /**
+   * @return the first loader that accepts the file, nullptr for OBJ
+   */
+  static const MeshLoader *Find(const std::string &filename, const char *head,
+                                std::size_t size, std::size_t file_size);
+
+  /**
+   * Reads the head of a regular file, other files are matched by name only
+   */
+  static const MeshLoader *Find(const std::string &filename);
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_MESHLOADER_H
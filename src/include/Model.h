@@ -5,13 +5,26 @@
 #ifndef INC_3DVIEWER_MODEL_H
 #define INC_3DVIEWER_MODEL_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
-#include "s21_matrix_oop.h"
+#include "AlignedAllocator.h"
+#include "BlockReader.h"
+#include "Decompressor.h"
+#include "MappedFile.h"
+#include "Mat4.h"
+#include "MeshLoader.h"
+#include "Pose.h"
+#include "StructuralIndex.h"
 
 /**
  * @file Model.cc - Model - part method's definitions
@@ -19,8 +32,8 @@
 
 namespace s21 {
 
-using vertex = std::vector<float>;
-using facet = std::vector<unsigned>;
+using vertex = std::vector<float, AlignedAllocator<float>>;
+using facet = std::vector<unsigned, AlignedAllocator<unsigned>>;
 
 /**
  * @struct Command
@@ -35,15 +48,233 @@ struct Command {
   virtual void execute() = 0;
 };
 
+/**
+ * @struct IndexBuffer
+ * @brief facet indices stored in the narrowest type that addresses them
+ */
+struct IndexBuffer {
+  /**
+   * @struct Batch
+   * @brief indices drawn by one call, relative to their base vertex
+   */
+  struct Batch {
+    std::size_t first = 0;
+    std::size_t count = 0;
+    unsigned base = 0;
+  };
+
+  /// bytes per index: 1, 2 or 4
+  unsigned width = sizeof(unsigned);
+  /// packed indices, width bytes each
+  std::vector<unsigned char> data;
+  std::vector<Batch> batches;
+
+  /**
+   * @return number of indices
+   */
+  [[nodiscard]] std::size_t size() const noexcept {
+    return data.size() / width;
+  }
+
+  /**
+   * @return index i with its batch base added back
+   */
+  [[nodiscard]] unsigned at(std::size_t i) const noexcept;
+
+  /**
+   * Packs line indices into 8 or 16 bits when the vertex count allows,
+   * larger meshes are split into 16-bit batches when the batches stay long
+   * @param indexes - pairs of vertex indices
+   * @param vertex_count - number of vertices they address
+   */
+  static IndexBuffer Pack(const facet &indexes, std::size_t vertex_count);
+
+  /// shortest average batch worth 16-bit indices, draw calls cost more below
+  static constexpr std::size_t kMinBatch = 1 << 12;
+};
+
+/**
+ * @struct QuantizedVertexes
+ * @brief positions stored as 16-bit fractions of the bounding box, every
+ * axis spans its own [lower, upper] range
+ */
+struct QuantizedVertexes {
+  std::vector<std::uint16_t> data;
+  /// position = offset + scale * data[i] / 65535 per axis, as the shaders
+  /// restore it
+  std::array<float, 3> offset{0, 0, 0};
+  std::array<float, 3> scale{1, 1, 1};
+  /// largest difference between an original and a restored coordinate
+  float error = 0;
+
+  /**
+   * @return number of coordinates
+   */
+  [[nodiscard]] std::size_t size() const noexcept { return data.size(); }
+
+  /**
+   * @return coordinate i restored to a float
+   */
+  [[nodiscard]] float at(std::size_t i) const noexcept {
+    return offset[i % 3] + scale[i % 3] * (float(data[i]) / 65535.0f);
+  }
+
+  /**
+   * Rounds every coordinate to the nearest of 65536 steps between lower and
+   * upper of its axis and measures the error
+   */
+  static QuantizedVertexes Quantize(const vertex &vertexes,
+                                    const std::array<float, 3> &lower,
+                                    const std::array<float, 3> &upper);
+};
+
+/**
+ * @struct Bounds
+ * @brief axis-aligned box of the vertices and the sphere around its center
+ */
+struct Bounds {
+  std::array<float, 3> lower{std::nanf("NAN"), std::nanf("NAN"),
+                             std::nanf("NAN")};
+  std::array<float, 3> upper{std::nanf("NAN"), std::nanf("NAN"),
+                             std::nanf("NAN")};
+  /// distance from the box center to the farthest vertex, 0 unless
+  /// LoadOptions::bounding_sphere is set
+  float radius = 0;
+
+  [[nodiscard]] std::array<float, 3> Center() const noexcept {
+    return {(lower[0] + upper[0]) / 2, (lower[1] + upper[1]) / 2,
+            (lower[2] + upper[2]) / 2};
+  }
+
+  /**
+   * @return half of the longest box side
+   */
+  [[nodiscard]] float HalfSize() const noexcept {
+    return std::max({upper[0] - lower[0], upper[1] - lower[1],
+                     upper[2] - lower[2]}) /
+           2;
+  }
+};
+
+/**
+ * @struct Group
+ * @brief faces that follow one g or o statement
+ */
+struct Group {
+  std::string name;
+  /// range of the group's line indices in facetes or the IndexBuffer
+  std::size_t first = 0;
+  std::size_t count = 0;
+  /// smallest range of vertices the indices address
+  unsigned first_vertex = 0;
+  unsigned vertex_count = 0;
+  /// box of the addressed vertices, radius with LoadOptions::bounding_sphere
+  Bounds bounds;
+};
+
+/**
+ * @struct LoadTimings
+ * @brief seconds spent in each stage of a load. The reader runs on its own
+ * thread beside the parser, so the stages can add up to more than total
+ */
+struct LoadTimings {
+  /// reading or decompressing the file on the reader thread, counting the
+  /// lines of a mapped file, or reading the cache
+  double read = 0;
+  /// parsing, the structural index included
+  double parse = 0;
+  /// time the parser waited for the reader, close to 0 unless reading is
+  /// the slowest stage
+  double stall = 0;
+  /// FinishGroups and ResolveIndexes
+  double resolve = 0;
+  /// LoadOptions::weld and LoadOptions::unique_edges
+  double dedup = 0;
+  double bounds = 0;
+  /// LoadOptions::pack_indexes and LoadOptions::quantize
+  double pack = 0;
+  /// whole OpenFileCommand::execute
+  double total = 0;
+  /// moving the arrays to the GPU, set by the widget that draws them
+  double upload = 0;
+};
+
 /**
  * @struct Obj
- * @brief result struct
+ * @brief result struct, owns its arrays and is only ever moved from the
+ * loader to the widget that draws it
  */
 struct Obj {
-  vertex *vertexes = nullptr;
-  facet *facetes = nullptr;
+  std::unique_ptr<vertex> vertexes;
+  std::unique_ptr<facet> facetes;
+  /// smallest and largest coordinate on any axis
   float min = std::nanf("NAN");
   float max = std::nanf("NAN");
+  /// vertices merged into others by welding
+  std::size_t welded = 0;
+  /// faces parsed without a parser specialized for their syntax, about one
+  /// per chunk when the file keeps to one syntax
+  std::size_t generic_faces = 0;
+  /// facetes packed by LoadOptions::pack_indexes, facetes is freed then
+  std::unique_ptr<IndexBuffer> indexes;
+  /// vertexes quantized by LoadOptions::quantize, vertexes is freed then
+  std::unique_ptr<QuantizedVertexes> quantized;
+  Bounds bounds;
+  /// consecutive index ranges in file order, empty if the file has no g or o
+  /// statements. Faces before the first one make up the "default" group
+  std::vector<Group> groups;
+  LoadTimings timings;
+};
+
+/**
+ * @struct LoadOptions
+ * @brief tunables for OpenFileCommand
+ */
+struct LoadOptions {
+  /// read the file through a memory mapping instead of a stream, binary
+  /// meshes (see MeshLoader) are always mapped
+  bool use_mmap = true;
+  /// ask for huge pages on the mapping, only a hint to the kernel
+  bool huge_pages = false;
+  /// files smaller than this are read through the stream
+  std::size_t mmap_threshold = 1 << 20;
+  /// read regular files that are not mapped with BlockReader, several large
+  /// reads in flight instead of one ifstream read at a time
+  bool async_reads = true;
+  /// make those reads bypass the page cache, for files read only once
+  bool direct_io = false;
+  /// parser threads, 0 means one per hardware thread
+  unsigned threads = 0;
+  /// smallest part of the file worth a separate thread
+  std::size_t chunk_size = 1 << 20;
+  /// polled between blocks, once set the command throws "Loading cancelled."
+  const std::atomic<bool> *cancel = nullptr;
+  /// called between blocks with the bytes parsed so far and the file size,
+  /// the size is 0 when it is unknown
+  std::function<void(std::size_t, std::size_t)> progress;
+  /// merge vertices with equal positions and remap face indices to them
+  bool weld = false;
+  /// 0 merges exactly equal positions only, otherwise every vertex merges
+  /// into the first kept vertex at most this far away. Nonzero values weld
+  /// on one thread
+  float weld_epsilon = 0;
+  /// store every undirected edge once, shared polygon edges are otherwise
+  /// stored once per polygon
+  bool unique_edges = false;
+  /// reopen unchanged files from a binary copy instead of parsing them
+  bool use_cache = false;
+  /// cache directory, empty means $XDG_CACHE_HOME/3dViewer
+  std::string cache_dir;
+  /// total size of cached files, the least recently used ones are removed
+  std::uintmax_t cache_limit = std::uintmax_t(256) << 20;
+  /// deflate cached arrays, smaller files but slower to reopen
+  bool cache_compress = false;
+  /// move facetes into Obj::indexes of the narrowest width
+  bool pack_indexes = false;
+  /// move vertexes into Obj::quantized, half the size at a bounded error
+  bool quantize = false;
+  /// also find Bounds::radius, one more pass over the vertices
+  bool bounding_sphere = false;
 };
 
 /**
@@ -55,8 +286,9 @@ class OpenFileCommand : public Command {
   /**
    * Ctor for initializing private vars
    */
-  OpenFileCommand(std::string filename, Obj &result)
-      : filename_(std::move(filename)), result_(result) {}
+  OpenFileCommand(std::string filename, Obj &result,
+                  const LoadOptions &options = {})
+      : filename_(std::move(filename)), result_(result), options_(options) {}
 
   void execute() override;
 
@@ -65,19 +297,279 @@ class OpenFileCommand : public Command {
 
   void ReadObj();
 
-  float &FindMaxMin(float &num) &noexcept;
+  void ReadMapped();
+
+  void ReadBuffered();
+
+  /**
+   * Fills the arrays from the mapped file with loader_
+   */
+  void ReadBinary();
+
+  /**
+   * Decompresses the file on a separate thread while this one parses the
+   * blocks it has already produced
+   */
+  void ReadCompressed();
+
+  /**
+   * Runs read on a separate thread that fills a bounded queue of blocks,
+   * this one parses them as they arrive, so reading and parsing overlap
+   * @param read - (data, capacity, consumed) -> bytes written to data, 0 at
+   * the end. Sets consumed to the bytes of the file used so far
+   * @param total - file size for the progress, 0 if unknown
+   */
+  template <class Read>
+  void ReadBlocks(Read read, std::size_t total);
+
+  /**
+   * @return size of in_file_, 0 if it can't seek
+   */
+  std::size_t StreamSize();
+
+  /**
+   * Reports the bytes parsed so far and stops the load if it was cancelled
+   */
+  void ReportProgress(std::size_t done, std::size_t total);
+
+  /**
+   * @enum FaceSyntax
+   * @brief what follows the vertex index in face tokens: nothing, /vt, //vn
+   * or /vt/vn
+   */
+  enum class FaceSyntax { kUnknown, kV, kVt, kVn, kVtVn };
+
+  /**
+   * @struct Chunk
+   * @brief vertices and facets parsed by one thread from a line-aligned chunk
+   */
+  struct Chunk {
+    vertex vertexes;
+    facet facetes;
+    /// positions in facetes of relative indices, they still lack the number
+    /// of vertices read before the chunk. All indices stay 1-based until
+    /// ResolveIndexes
+    std::vector<unsigned> relative;
+    /// groups started in the chunk, first is relative to the chunk
+    std::vector<Group> groups;
+    /// the chunk already holds every vertex read before it
+    bool direct = false;
+    /// syntax of the last face parsed
+    FaceSyntax syntax = FaceSyntax::kUnknown;
+    /// faces that went through ParseAnyFacet
+    std::size_t generic_faces = 0;
+  };
+
+  /**
+   * Splits a range of complete lines into chunks, parses them in parallel
+   * and appends the result in file order
+   * @param begin - first char of the range
+   * @param end - past-the-end char, the range ends with a line break or EOF
+   */
+  void ParseRange(const char *begin, const char *end);
+
+  void MergeChunks(std::size_t count);
+
+  /**
+   * Adds the default group if faces come before the first group, sets the
+   * group sizes and drops groups without faces
+   */
+  void FinishGroups();
+
+  /**
+   * Turns the parsed 1-based indices into 0-based ones and checks that each
+   * addresses a vertex
+   * @throw std::runtime_error naming the line of the first bad index
+   */
+  void ResolveIndexes();
+
+  /**
+   * Reads the OBJ file again to find the line a parsed index came from,
+   * only used to report errors
+   * @return 1-based line number, 0 if the file can't be read again
+   */
+  std::size_t LineOfIndex(std::size_t position) const;
+
+  /**
+   * Merges vertices with equal positions (see LoadOptions::weld_epsilon)
+   * into their first occurrence and remaps face indices
+   */
+  void WeldVertexes();
+
+  /**
+   * Finds Obj::bounds, min and max with a vectorized reduction over the
+   * vertices, split between threads for large meshes, then the bounds and
+   * vertex ranges of the groups
+   */
+  void ComputeBounds();
+
+  /**
+   * Load options that change the result, see MeshCache
+   */
+  std::uint64_t CacheVariant() const noexcept;
+
+  /**
+   * Leaves one canonical (smaller index first) copy of every undirected edge,
+   * in order of first occurrence
+   */
+  void DeduplicateEdges();
+
+  /**
+   * Runs task(0) .. task(count - 1) on separate threads, the first one on the
+   * calling thread, and rethrows the first exception thrown by a task
+   */
+  template <class Task>
+  static void RunParallel(std::size_t count, const Task &task);
+
+  /**
+   * @struct Hashed
+   * @brief element and its hash, see ScatterByHash
+   */
+  struct Hashed {
+    std::uint64_t hash;
+    unsigned index;
+  };
+
+  /**
+   * Hashes elements 0 .. count - 1 once, each of parts threads a range of
+   * them, and sorts them by the part (hash >> 32) % parts that owns them.
+   * Bucket range * parts + part holds a range's elements of the part in
+   * order, so reading a part's buckets by range visits its elements in order
+   * @param hash_of - element index to its hash
+   */
+  template <class HashOf>
+  static std::vector<std::vector<Hashed>> ScatterByHash(
+      std::size_t count, std::size_t parts, const HashOf &hash_of);
+
+  /**
+   * Parses blocks of lines through their StructuralIndex, lines longer than
+   * a block and CPUs without SIMD one char at a time
+   */
+  static void ParseLines(const char *begin, const char *end, Chunk &chunk);
+
+  /**
+   * Parses the lines of a block from the token positions of its index, the
+   * record type from the keyword token
+   */
+  static void ParseIndexed(const char *begin, const char *end,
+                           const StructuralIndex &index, Chunk &chunk);
+
+  static void ParseLine(const char *begin, const char *eol, Chunk &chunk);
+
+  static void ParseVertex(const char *pos, const char *end, Chunk &chunk);
+
+  /**
+   * Parses a vertex from its tokens, the line is parsed again by the char
+   * if a number doesn't span its whole token
+   * @param line - start of the line
+   * @param text - start of the block the token positions are relative to
+   * @param tokens - positions of the tokens after the keyword
+   * @param count - number of tokens
+   */
+  static void ParseVertex(const char *line, const char *eol, const char *text,
+                          const std::uint16_t *tokens, std::size_t count,
+                          Chunk &chunk);
+
+  /**
+   * Parses a face with the parser specialized for the syntax of the previous
+   * one, a face of another syntax goes through ParseAnyFacet and sets the
+   * syntax for the next ones
+   */
+  static void ParseFacet(const char *pos, const char *end, Chunk &chunk);
 
-  unsigned int CorrectIndex(const int &num) const noexcept;
+  static void ParseAnyFacet(const char *pos, const char *end, Chunk &chunk);
+
+  /**
+   * Parses a face whose tokens all have the given syntax and whose indices
+   * fit in 9 digits
+   * @return false, having added nothing, if the face is not like that
+   */
+  template <FaceSyntax kSyntax>
+  static bool ParseFacetAs(const char *pos, const char *end, Chunk &chunk);
+
+  /**
+   * ParseFacetAs from the tokens of a StructuralIndex, see the ParseVertex
+   * overload
+   */
+  template <FaceSyntax kSyntax>
+  static bool ParseFacetAs(const char *eol, const char *text,
+                           const std::uint16_t *tokens, std::size_t count,
+                           Chunk &chunk);
+
+  /**
+   * Calls parse with std::integral_constant<FaceSyntax, syntax>
+   * @return what parse returns, false for kUnknown
+   */
+  template <class Parse>
+  static bool WithSyntax(FaceSyntax syntax, const Parse &parse);
+
+  /**
+   * Writes the edges of a face with the given 1-based or relative indices
+   */
+  static void AddFacet(const int *nums, std::size_t count, Chunk &chunk);
+
+  /**
+   * Skips the /vt, //vn or /vt/vn part of a face token
+   * @return position after it or nullptr if the token has another syntax
+   */
+  template <FaceSyntax kSyntax>
+  static const char *SkipAttributes(const char *pos, const char *end);
+
+  /**
+   * @return syntax of the first token of a face, kUnknown for any other
+   */
+  static FaceSyntax DetectSyntax(const char *pos, const char *end);
+
+  /**
+   * Parses a face from its tokens like the other ParseFacet, see the
+   * ParseVertex overload
+   */
+  static void ParseFacet(const char *eol, const char *text,
+                         const std::uint16_t *tokens, std::size_t count,
+                         Chunk &chunk);
+
+  static void ParseAnyFacet(const char *eol, const char *text,
+                            const std::uint16_t *tokens, std::size_t count,
+                            Chunk &chunk);
+
+  static void ParseGroup(const char *pos, const char *end, Chunk &chunk);
+
+  static void PushIndex(int num, Chunk &chunk);
+
+  /**
+   * @return index of the vertex a face index refers to, a relative one is
+   * noted in the chunk
+   * @param position - where the index goes in the chunk's facetes
+   */
+  static unsigned ResolveIndex(int num, std::size_t position, Chunk &chunk);
 
  private:
+  static constexpr std::size_t kBlockSize = 1 << 20;
+  static constexpr std::size_t kWindowSize = 64 << 20;
+  static constexpr std::size_t kParallelEdges = 1 << 20;
+  static constexpr std::size_t kParallelVertexes = 1 << 20;
+  static constexpr std::size_t kParallelIndexes = 1 << 22;
+  /// decompressed blocks in flight between the two threads
+  static constexpr std::size_t kQueueBlocks = 4;
+  /// corners of the faces ParseFacetAs handles
+  static constexpr std::size_t kMaxCorners = 32;
+
   std::string filename_;
   Obj &result_;
+  LoadOptions options_;
+  MappedFile mapped_;
   std::ifstream in_file_;
+  Decompressor::Format format_ = Decompressor::Format::kPlain;
+  /// loader of a format other than OBJ, nullptr for OBJ
+  const MeshLoader *loader_ = nullptr;
+  std::size_t threads_ = 1;
+  std::vector<Chunk> chunks_;
 };
 
 /**
  * @class RotateCommand
- * @brief Command pattern's class for rotate command
+ * @brief Command pattern's class for rotate command, turns a Pose by Euler
+ * angles around x, y and z
  */
 class RotateCommand : public Command {
  public:
@@ -85,11 +577,11 @@ class RotateCommand : public Command {
   /**
    * Ctor for initializing private vars
    */
-  RotateCommand(float *matrix, const std::vector<float> &vec)
-      : matrix_(matrix), angle_(vec) {}
+  RotateCommand(Pose &pose, const std::vector<float> &vec)
+      : pose_(pose), angle_(vec) {}
 
  private:
-  float *matrix_;
+  Pose &pose_;
   const std::vector<float> angle_;
 };
 
@@ -103,11 +595,11 @@ class ScaleCommand : public Command {
   /**
    * Ctor for initializing private vars
    */
-  ScaleCommand(float *matrix, const float &factor)
-      : matrix_(matrix), factor_(factor) {}
+  ScaleCommand(Pose &pose, const float &factor)
+      : pose_(pose), factor_(factor) {}
 
  private:
-  float *matrix_;
+  Pose &pose_;
   const float factor_;
 };
 
@@ -121,11 +613,11 @@ class TranslateCommand : public Command {
   /**
    * Ctor for initializing private vars
    */
-  TranslateCommand(float *matrix, const std::vector<float> &vec)
-      : matrix_(matrix), vec_(vec) {}
+  TranslateCommand(Pose &pose, const std::vector<float> &vec)
+      : pose_(pose), vec_(vec) {}
 
  private:
-  float *matrix_;
+  Pose &pose_;
   const std::vector<float> vec_;
 };
 
@@ -141,7 +633,7 @@ class GenOrthoCommand : public Command {
    */
   GenOrthoCommand(const float &left, const float &right, const float &bottom,
                   const float &top, const float &near, const float &far,
-                  float *&result)
+                  Mat4 &result)
       : result_(result),
         left_(left),
         right_(right),
@@ -151,7 +643,7 @@ class GenOrthoCommand : public Command {
         far_(far) {}
 
  private:
-  float *&result_;
+  Mat4 &result_;
   const float &left_, &right_, &bottom_, &top_, &near_, &far_;
 };
 
@@ -166,11 +658,11 @@ class GenPerspectiveCommand : public Command {
    * Ctor for initializing private vars
    */
   GenPerspectiveCommand(const float &fov, const float &aspect,
-                        const float &near, const float &far, float *&result)
+                        const float &near, const float &far, Mat4 &result)
       : result_(result), fov_(fov), aspect_(aspect), near_(near), far_(far) {}
 
  private:
-  float *&result_;
+  Mat4 &result_;
   const float &fov_, &aspect_, &near_, &far_;
 };
 
@@ -8,8 +8,9 @@
 #include <QOpenGLFunctions>
 #include <QOpenGLWidget>
 
+#include "Camera.h"
+#include "Model.h"
 #include "qtshader.h"
-#include "s21_matrix_oop.h"
 
 /**
  * @file OpenGlWidget.cc - file with opengl part implementation's definitions
@@ -29,6 +30,30 @@ struct config {
   unsigned vertices = 0;
   unsigned vertices_size = 10;
   unsigned edges_thickness = 5;
+  bool quantize = false;
+  bool use_cache = false;
+};
+
+/**
+ * @struct DrawList
+ * @brief index ranges of the visible groups, drawn by one multi-draw call
+ */
+struct DrawList {
+  GLenum type = GL_UNSIGNED_INT;
+  std::vector<GLsizei> counts;
+  /// byte offsets into the index buffer
+  std::vector<const void *> offsets;
+  std::vector<GLint> bases;
+};
+
+/**
+ * @struct PointList
+ * @brief vertex ranges the visible groups address, drawn by one
+ * multi-draw call
+ */
+struct PointList {
+  std::vector<GLint> firsts;
+  std::vector<GLsizei> counts;
 };
 
 /**
@@ -39,8 +64,31 @@ class Strategy {
  public:
   Strategy() = default;
   virtual ~Strategy() = default;
-  virtual void Render(QtShader shader, const S21Matrix &mvp, const config &conf,
+  virtual void Render(QtShader shader, const Mat4 &mvp, const config &conf,
                       const int &size) = 0;
+
+  /**
+   * @param offset, scale - positions are drawn at offset + scale * position,
+   * per axis
+   */
+  void SetPosition(const std::array<float, 3> &offset,
+                   const std::array<float, 3> &scale) noexcept {
+    offset_ = offset;
+    scale_ = scale;
+  }
+
+ protected:
+  /**
+   * Sets the uniforms that restore quantized positions
+   */
+  void SetPositionUniforms(QtShader &shader) const {
+    shader.SetUniVec3Fl("u_offset", offset_);
+    shader.SetUniVec3Fl("u_scale", scale_);
+  }
+
+ private:
+  std::array<float, 3> offset_{0, 0, 0};
+  std::array<float, 3> scale_{1, 1, 1};
 };
 
 /**
@@ -49,8 +97,16 @@ class Strategy {
  */
 class VertexStrategy : public Strategy, protected QOpenGLExtraFunctions {
  public:
-  void Render(QtShader shader, const S21Matrix &mvp, const config &conf,
+  /**
+   * @param points - ranges of the bound vertex buffer to draw
+   */
+  explicit VertexStrategy(const PointList *points) : points_(points) {}
+
+  void Render(QtShader shader, const Mat4 &mvp, const config &conf,
               const int &size) override;
+
+ private:
+  const PointList *points_;
 };
 
 /**
@@ -59,8 +115,16 @@ class VertexStrategy : public Strategy, protected QOpenGLExtraFunctions {
  */
 class LinesStrategy : public Strategy, protected QOpenGLExtraFunctions {
  public:
-  void Render(QtShader shader, const S21Matrix &mvp, const config &conf,
+  /**
+   * @param draws - ranges of the bound index buffer to draw
+   */
+  explicit LinesStrategy(const DrawList *draws) : draws_(draws) {}
+
+  void Render(QtShader shader, const Mat4 &mvp, const config &conf,
               const int &size) override;
+
+ private:
+  const DrawList *draws_;
 };
 
 /**
@@ -81,41 +145,27 @@ class OpenGLWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions {
 
   /**
    * Signal to rotate model matrix
-   * @param mx - matrix to rotate
+   * @param pose - model placement to rotate
    * @param - rotation vector
    */
-  void RotateMatrix(float *, const std::vector<float> &);
+  void RotateMatrix(s21::Pose *, const std::vector<float> &);
 
   /**
    * Signal to translate model matrix
-   * @param mx - matrix to translate
+   * @param pose - model placement to translate
    * @param vec - translation vector
    */
-  void TranslateMatrix(float *, const std::vector<float> &);
+  void TranslateMatrix(s21::Pose *, const std::vector<float> &);
 
   /**
    * Signal to scale model matrix
-   * @param mx - matrix to scale
+   * @param pose - model placement to scale
    * @param factor - scale factor
    */
-  void ScaleMatrix(float *, const float &);
-
-  /**
-   * Signal to get Ortho matrix based in provided values
-   */
-  void GetOrthoMatrix(const float &, const float &, const float &,
-                      const float &, const float &, const float &);
+  void ScaleMatrix(s21::Pose *, const float &);
 
-  /**
-   * Signal to get Perspective matrix based in provided values
-   */
-  void GetPerspectiveMatrix(const float &, const float &, const float &,
-                            const float &);
 
  public:
-  using vertex = std::vector<float>;
-  using facet = std::vector<unsigned>;
-
   /**
    * opengl class ctor
    * @param parent Qwidget parent
@@ -143,14 +193,18 @@ class OpenGLWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions {
   void paintGL() override;
 
   /**
-   * Method sets class private vars with input data from newly opened file
-   * @param vx - pointer to vertex vector
-   * @param ft - pointer to facets vector
-   * @param min - min vertex value
-   * @param max - max vertex value
+   * Method takes over the arrays of a newly opened file and uploads them.
+   * Uses obj.indexes, obj.quantized or else obj.vertexes, obj.bounds to
+   * center and fit the model by and obj.groups, all visible at first
+   * @param obj - result of OpenFileCommand with LoadOptions::pack_indexes
    */
-  void SetObj(const vertex *vx, const facet *ft, const float &min,
-              const float &max);
+  void SetObj(Obj obj);
+
+  /**
+   * Shows or hides the faces of a group
+   * @param group - position in the groups passed to SetObj
+   */
+  void SetGroupVisible(std::size_t group, bool visible);
 
   /**
    * Public method for rotation. Needed to cal from ui.
@@ -170,13 +224,6 @@ class OpenGLWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions {
    */
   void RotateObject(const std::vector<float> &vec);
 
-  /**
-   * Public method called from viewer to set result matrix provided by
-   * controller
-   * @param factor
-   */
-  void SetResultMatrix(float *result);
-
  private:
   /**
    * Setting Opengl buffers
@@ -184,9 +231,17 @@ class OpenGLWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions {
   void SetBuffers();
 
   /**
-   * Frees private vars
+   * Collects the index ranges of the visible groups, split at the index
+   * buffer batches, and the vertex ranges they address. Adjacent ranges
+   * are drawn as one
    */
-  void FreeBuffers();
+  void UpdateDrawList();
+
+  /**
+   * Collects the vertex ranges of the visible groups, all vertices while
+   * every group is visible
+   */
+  void UpdatePointList();
 
   /*
    * Get position of pressed mouse button
@@ -210,30 +265,33 @@ class OpenGLWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions {
    */
   void wheelEvent(QWheelEvent *event) override;
 
-  /**
-   * Choosing and setting perspective matrix
-   */
-  void SetPerspectiveMatrix();
-
   /**
    * Sets strategy fro Strategy pattern
-   * @param strategy
+   * @param strategy - one of the widget's strategies
    */
-  void SetStrategy(std::unique_ptr<s21::Strategy> &&strategy) {
-    current_render_strategy_ = std::move(strategy);
+  void SetStrategy(s21::Strategy *strategy) {
+    current_render_strategy_ = strategy;
   }
 
  private:
-  const s21::S21Matrix view_ = {
-      4, 4, {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -1.0f, 1}};
-  const vertex *vertexes = nullptr;
-  const facet *facetes = nullptr;
-  s21::S21Matrix projection_, mvp_,
-      identity_ = s21::S21Matrix::CreateIdentity(4), *needed_matrix_ = nullptr;
+  /// aspect of the perspective projection, whatever the widget's size
+  static constexpr float kAspect = 600.0f / 800.0f;
+  std::unique_ptr<const vertex> vertexes;
+  std::unique_ptr<const QuantizedVertexes> quantized;
+  std::unique_ptr<const IndexBuffer> indexes;
+  std::vector<Group> groups_;
+  std::vector<bool> visible_;
+  DrawList draws_;
+  PointList points_;
+  s21::Camera camera_;
+  s21::Mat4 mvp_;
+  s21::Pose pose_;
   GLuint VAO = 0, VBO = 0, IBO = 0;
   s21::QtShader lines_shader, point_shader;
   QPoint mPos;
-  std::unique_ptr<s21::Strategy> current_render_strategy_;
+  s21::LinesStrategy lines_strategy_{&draws_};
+  s21::VertexStrategy vertex_strategy_{&points_};
+  s21::Strategy *current_render_strategy_ = &lines_strategy_;
 };
 
 /**
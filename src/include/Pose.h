@@ -0,0 +1,150 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_POSE_H
+#define INC_3DVIEWER_POSE_H
+
+#include <cmath>
+
+#include "Mat4.h"
+
+/**
+ * @file Pose.h - model placement as rotation, scale and translation
+ */
+
+namespace s21 {
+
+/**
+ * @struct Quat
+ * @brief rotation quaternion w + xi + yj + zk
+ */
+struct Quat {
+  float w = 1, x = 0, y = 0, z = 0;
+
+  /**
+   * @param axis_x, axis_y, axis_z - unit axis
+   * @param angle - in radians, counterclockwise looking down the axis
+   */
+  static Quat FromAxis(float axis_x, float axis_y, float axis_z,
+                       float angle) noexcept {
+    const float s = std::sin(angle / 2);
+    return {std::cos(angle / 2), axis_x * s, axis_y * s, axis_z * s};
+  }
+
+  /**
+   * Rotation by other, then by this
+   */
+  constexpr Quat operator*(const Quat &other) const noexcept {
+    return {w * other.w - x * other.x - y * other.y - z * other.z,
+            w * other.x + x * other.w + y * other.z - z * other.y,
+            w * other.y - x * other.z + y * other.w + z * other.x,
+            w * other.z + x * other.y - y * other.x + z * other.w};
+  }
+
+  [[nodiscard]] constexpr float Norm2() const noexcept {
+    return w * w + x * x + y * y + z * z;
+  }
+
+  void Normalize() noexcept {
+    const float inverse = 1 / std::sqrt(Norm2());
+    w *= inverse;
+    x *= inverse;
+    y *= inverse;
+    z *= inverse;
+  }
+
+  /**
+   * Rotates the x, y and z of vec, w is kept. Assumes a unit quaternion
+   */
+  [[nodiscard]] constexpr Vec4 Rotate(const Vec4 &vec) const noexcept {
+    // vec + w * t + (x, y, z) x t, where t = 2 (x, y, z) x vec
+    const float tx = 2 * (y * vec[2] - z * vec[1]);
+    const float ty = 2 * (z * vec[0] - x * vec[2]);
+    const float tz = 2 * (x * vec[1] - y * vec[0]);
+    return Vec4{{vec[0] + w * tx + y * tz - z * ty,
+                 vec[1] + w * ty + z * tx - x * tz,
+                 vec[2] + w * tz + x * ty - y * tx, vec[3]}};
+  }
+};
+
+/**
+ * @class Pose
+ * @brief model matrix kept as a rotation quaternion, a uniform scale and a
+ * translation. Turns are combined as quaternions and the matrix is built
+ * only when it is drawn. The rotation is rebuilt orthonormal from the
+ * quaternion every time, so repeated turns can't skew the model
+ */
+class Pose {
+ public:
+  /// turns between renormalizations of the quaternion
+  static constexpr int kRenormalizeEvery = 64;
+
+  /**
+   * Turns by the same Euler angles RotateCommand always took: the model
+   * matrix M becomes (Rx(x) Ry(y) Rz(z))^T M. Zero angles cost nothing
+   */
+  void Rotate(float x, float y, float z) noexcept {
+    Quat turn;
+    if (z != 0) turn = Quat::FromAxis(0, 0, 1, -z);
+    if (y != 0) turn = turn * Quat::FromAxis(0, 1, 0, -y);
+    if (x != 0) turn = turn * Quat::FromAxis(1, 0, 0, -x);
+    rotation_ = turn * rotation_;
+    translation_ = turn.Rotate(translation_);
+    // the matrix doesn't depend on the length, this only keeps it from
+    // creeping away from 1 over a long drag
+    if (++turns_ == kRenormalizeEvery) {
+      turns_ = 0;
+      rotation_.Normalize();
+    }
+  }
+
+  /// scales about the model's origin, the translation is kept
+  void Scale(float factor) noexcept { scale_ *= factor; }
+
+  void Translate(float x, float y, float z) noexcept {
+    translation_[0] += x;
+    translation_[1] += y;
+    translation_[2] += z;
+  }
+
+  /**
+   * @return the model matrix, a column vector transform with the
+   * translation in the last column, as paintGL multiplies it
+   */
+  [[nodiscard]] Mat4 ToMat4() const noexcept {
+    const auto &[w, x, y, z] = rotation_;
+    // 2 / |q|^2 instead of 2 makes any quaternion's rotation orthonormal
+    const float k = 2 / rotation_.Norm2();
+    const float s = scale_;
+    Mat4 result;
+    result(0, 0) = s * (1 - k * (y * y + z * z));
+    result(0, 1) = s * k * (x * y - w * z);
+    result(0, 2) = s * k * (x * z + w * y);
+    result(1, 0) = s * k * (x * y + w * z);
+    result(1, 1) = s * (1 - k * (x * x + z * z));
+    result(1, 2) = s * k * (y * z - w * x);
+    result(2, 0) = s * k * (x * z - w * y);
+    result(2, 1) = s * k * (y * z + w * x);
+    result(2, 2) = s * (1 - k * (x * x + y * y));
+    for (int i = 0; i < 3; ++i) result(i, 3) = translation_[i];
+    result(3, 3) = 1;
+    return result;
+  }
+
+  [[nodiscard]] const Quat &GetRotation() const noexcept { return rotation_; }
+  [[nodiscard]] float GetScale() const noexcept { return scale_; }
+  [[nodiscard]] const Vec4 &GetTranslation() const noexcept {
+    return translation_;
+  }
+
+ private:
+  Quat rotation_;
+  float scale_ = 1;
+  Vec4 translation_;
+  int turns_ = 0;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_POSE_H
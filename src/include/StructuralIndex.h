@@ -0,0 +1,72 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#ifndef INC_3DVIEWER_STRUCTURALINDEX_H
+#define INC_3DVIEWER_STRUCTURALINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file StructuralIndex.cc - structural index of OBJ text definitions
+ */
+
+namespace s21 {
+
+/**
+ * @class StructuralIndex
+ * @brief positions of the token starts and line breaks of a block of text,
+ * in order. Built with SIMD compares 64 chars at a time, so the parser jumps
+ * from token to token instead of looking for blanks one char at a time.
+ * '/' separators and record types are not indexed: a face corner's index is
+ * read before its first '/' and the /vt/vn tail doesn't change the result,
+ * and the record type is the first char of a line the parser loads anyway.
+ * Neither would save more than it costs to emit
+ */
+class StructuralIndex {
+ public:
+  /// instruction sets the index can be built with
+  enum class Isa { kScalar, kSse2, kAvx2 };
+
+  /// largest block, positions are 16-bit offsets from its start
+  static constexpr std::size_t kMaxBlock = 1 << 16;
+
+  /**
+   * @return the widest instruction set the running CPU supports, checked
+   * once
+   */
+  static Isa Best() noexcept;
+
+  /**
+   * @return whether this build and the running CPU support isa
+   */
+  static bool Supported(Isa isa) noexcept;
+
+  /**
+   * Indexes a block, a token starts at each non-blank char that follows a
+   * blank, a line break or the start of the block
+   * @param text - start of the block, also the start of a line
+   * @param size - at most kMaxBlock
+   * @param isa - instruction set to build with, must be supported
+   * @throw std::runtime_error if the block is too large
+   */
+  void Build(const char *text, std::size_t size, Isa isa = Best());
+
+  [[nodiscard]] const std::uint16_t *begin() const noexcept {
+    return positions_.data();
+  }
+  [[nodiscard]] const std::uint16_t *end() const noexcept {
+    return positions_.data() + size_;
+  }
+  [[nodiscard]] std::size_t size() const noexcept { return size_; }
+
+ private:
+  std::vector<std::uint16_t> positions_;
+  std::size_t size_ = 0;
+};
+
+}  // namespace s21
+
+#endif  // INC_3DVIEWER_STRUCTURALINDEX_H
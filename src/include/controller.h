@@ -5,7 +5,12 @@
 #ifndef SMARTCALC2_CONTROLLER_H
 #define SMARTCALC2_CONTROLLER_H
 
+#include <QList>
 #include <QObject>
+#include <QPointer>
+#include <QThread>
+#include <atomic>
+#include <memory>
 
 #include "Model.h"
 #include "viewer.h"
@@ -35,52 +40,65 @@ class controller final : public QObject {
    */
   controller(Model *model, viewer *view, QObject *parent = nullptr);
 
-  ~controller() override = default;
+  /**
+   * Cancels running loads and waits for their threads
+   */
+  ~controller() override;
 
  private slots:
   /**
-   * Slot for file opening
+   * Slot for file opening. Starts loading on a worker thread, a load that is
+   * still running is cancelled. The view keeps the current model until the
+   * new one is ready.
    * @param filename - file to open
+   * @param quantize - store positions as 16-bit integers
+   * @param use_cache - reopen unchanged files from a binary copy
+   */
+  void OpenFile(const QString &filename, bool quantize, bool use_cache);
+
+  /**
+   * Slot to cancel the running load
    */
-  void OpenFile(const QString &filename) const;
+  void CancelOpen();
 
   /**
    * Slot to rotate model matrix
-   * @param mx - matrix to rotate
+   * @param pose - model placement to rotate
    * @param - rotation vector
    */
-  void Rotate(float *mx, const std::vector<float> &vec) const;
+  void Rotate(Pose *pose, const std::vector<float> &vec) const;
 
   /**
    * Slot to translate model matrix
-   * @param mx - matrix to translate
+   * @param pose - model placement to translate
    * @param vec - translation vector
    */
-  void Translate(float *mx, const std::vector<float> &vec) const;
+  void Translate(Pose *pose, const std::vector<float> &vec) const;
 
   /**
    * Slot to scale model matrix
-   * @param mx - matrix to scale
+   * @param pose - model placement to scale
    * @param factor - scale factor
    */
-  void Scale(float *, const float &) const;
-
-  /**
-   * Slot to get Ortho matrix based in provided values
-   */
-  void GetOrtho(const float &, const float &, const float &, const float &,
-                const float &, const float &) const;
+  void Scale(Pose *, const float &) const;
 
+ private:
   /**
-   * Slot to get Perspective matrix based in provided values
+   * Passes a finished load to the view, runs on the GUI thread
+   * @param generation - number of the load, results of stale loads are freed
+   * @param result - loaded model, empty on error
+   * @param error - error message
    */
-  void GetPerspective(const float &, const float &, const float &,
-                      const float &) const;
+  void FinishOpen(unsigned generation, Obj result, const QString &error);
 
  private:
   Model *model_;
 
   viewer *view_;
+
+  QList<QPointer<QThread>> loaders_;
+  std::shared_ptr<std::atomic<bool>> cancel_;
+  unsigned generation_ = 0;
 };
 
 }  // namespace s21
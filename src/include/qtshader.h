@@ -2,6 +2,7 @@
 #define QTSHADER_H
 
 #include <QtOpenGL>
+#include <array>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -45,7 +46,14 @@ class QtShader : public QOpenGLFunctions {
   @param name - variable name.
   @param vec - its' data.
   */
-  void SetUniVec4Fl(const char *name, const std::vector<float> &vec);
+  void SetUniVec4Fl(const char *name, const std::array<float, 3> &vec);
+
+  /**
+  @brief This function setups a uniform vec3 variable inside the shader.
+  @param name - variable name.
+  @param vec - its' data.
+  */
+  void SetUniVec3Fl(const char *name, const std::array<float, 3> &vec);
 
   /**
   @brief This function returns shader program id.
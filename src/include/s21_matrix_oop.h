@@ -43,6 +43,9 @@ class S21Matrix {
   [[nodiscard]] const float *GetPointer() const;
   float *GetPointer();
 
+  [[nodiscard]] int GetRows() const noexcept { return rows_; }
+  [[nodiscard]] int GetCols() const noexcept { return cols_; }
+
   static S21Matrix CreateIdentity(int dimension);
   static S21Matrix Init4x4fv(float *matrix);
 
@@ -6,9 +6,15 @@
 #define C8_3DVIEWER_V1_0_1_SRC_SOURCES_QT_VIEWER_H_
 
 #include <QAbstractButton>
+#include <QCheckBox>
+#include <QDockWidget>
+#include <QListWidget>
 #include <QMainWindow>
+#include <QProgressBar>
+#include <QPushButton>
 #include <cmath>
 
+#include "Model.h"
 #include "gif.h"
 
 /**
@@ -31,17 +37,6 @@ class viewer : public QMainWindow {
  public:
   static constexpr char config_filename[] = "settings.conf";
 
-  /**
-   * @struct obj
-   * @brief Same result class as in model
-   */
-  struct obj {
-    std::vector<float> *vertexes = nullptr;
-    std::vector<unsigned> *facetes = nullptr;
-    float min = std::nanf("NAN");
-    float max = std::nanf("NAN");
-  };
-
   /**
    * Qt class ctor. Sets ui and connects
    * @param parent
@@ -61,54 +56,53 @@ class viewer : public QMainWindow {
 
   /**
    * Public func to set result
-   * @param input - result object
+   * @param input - result object, handed on to the OpenGL widget
    */
-  void SetResult(const obj &input);
+  void SetResult(Obj input);
 
   /**
-   * Public func to set result in opengl class
-   * @param result - result matrix to be set
+   * Public func to show loading progress
+   * @param done - bytes parsed so far
+   * @param total - file size, 0 if unknown
    */
-  void SetResultMatrix(float *result);
+  void SetProgress(std::size_t done, std::size_t total);
+
  signals:
   /**
    * Signal to open the file
    * @param filename - file
+   * @param quantize - store positions as 16-bit integers
+   * @param use_cache - reopen unchanged files from a binary copy
    */
-  void OpenFileSignal(const QString &filename);
+  void OpenFileSignal(const QString &filename, bool quantize,
+                      bool use_cache);
+
+  /**
+   * Signal to cancel the file being opened
+   */
+  void CancelOpenSignal();
 
   /**
    * Signal to rotate model matrix
-   * @param mx - matrix to rotate
+   * @param pose - model placement to rotate
    * @param - rotation vector
    */
-  void RotateMatrix(float *, const std::vector<float> &);
+  void RotateMatrix(s21::Pose *, const std::vector<float> &);
 
   /**
    * Signal to translate model matrix
-   * @param mx - matrix to translate
+   * @param pose - model placement to translate
    * @param vec - translation vector
    */
-  void TranslateMatrix(float *, const std::vector<float> &);
+  void TranslateMatrix(s21::Pose *, const std::vector<float> &);
 
   /**
    * Signal to scale model matrix
-   * @param mx - matrix to scale
+   * @param pose - model placement to scale
    * @param factor - scale factor
    */
-  void ScaleMatrix(float *, const float &);
+  void ScaleMatrix(s21::Pose *, const float &);
 
-  /**
-   * Signal to get Ortho matrix based in provided values
-   */
-  void GetOrthoMatrix(const float &, const float &, const float &,
-                      const float &, const float &, const float &);
-
-  /**
-   * Signal to get Perspective matrix based in provided values
-   */
-  void GetPerspectiveMatrix(const float &, const float &, const float &,
-                            const float &);
  private slots:
   void on_open_file_clicked();
   void on_chooser_buttonClicked(QAbstractButton *button);
@@ -156,9 +150,34 @@ class viewer : public QMainWindow {
    */
   void SetUiFromConfig();
 
+  /**
+   * Shows or hides the progress bar and the cancel button
+   * @param visible
+   */
+  void ShowProgress(bool visible);
+
+  /**
+   * Fills the groups list, one checkable row per distinct group name
+   * @param groups - groups of the opened file
+   */
+  void SetGroups(const std::vector<Group> &groups);
+
+  /**
+   * Puts the time of each load stage into the status bar tooltip
+   * @param timings - of the last load, upload included
+   */
+  void ShowTimings(const LoadTimings &timings);
+
  private:
-  bool error = false;
   Ui::viewer *ui;
+  QProgressBar *progress_;
+  QPushButton *cancel_;
+  QCheckBox *quantize_;
+  QCheckBox *use_cache_;
+  QDockWidget *groups_dock_;
+  QListWidget *groups_list_;
+  std::vector<std::vector<std::size_t>> groups_of_row_;
+  QString loading_file_;
   GifWriter g;
   QTimer *screencast_timer;
   int counter = 0;
@@ -0,0 +1,367 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#include "BlockReader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define S21_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+namespace s21 {
+
+#ifdef S21_HAVE_IO_URING
+/**
+ * @class BlockReader::Ring
+ * @brief minimal io_uring: one submission per read, completions waited for
+ * one at a time. Talks to the kernel through the raw system calls, so there
+ * is no liburing dependency
+ */
+class BlockReader::Ring {
+ public:
+  Ring() = default;
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+  ~Ring() {
+    if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqes_size_);
+    if (cq_ != MAP_FAILED && cq_ != sq_) ::munmap(cq_, cq_size_);
+    if (sq_ != MAP_FAILED) ::munmap(sq_, sq_size_);
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  /**
+   * Creates the ring and checks that it supports plain reads
+   * @return false if io_uring is missing, disabled or too old
+   */
+  bool Setup(unsigned entries) noexcept {
+    io_uring_params params{};
+    fd_ = int(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0 || !SupportsRead()) return false;
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    sq_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ == MAP_FAILED) return false;
+    cq_ = single ? sq_
+                 : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ == MAP_FAILED) return false;
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) return false;
+
+    auto *sq = static_cast<char *>(sq_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<char *>(cq_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  /**
+   * Queues and submits a read, the caller keeps at most entries in flight
+   * @param tag - returned with the completion
+   * @return negative errno if the kernel refused it
+   */
+  int Read(int fd, char *data, std::size_t size, std::size_t offset,
+           std::uint64_t tag) noexcept {
+    const unsigned tail = *sq_tail_;
+    const unsigned index = tail & sq_mask_;
+    auto &sqe = static_cast<io_uring_sqe *>(sqes_)[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<std::uint64_t>(data);
+    sqe.len = unsigned(size);
+    sqe.off = offset;
+    sqe.user_data = tag;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    int submitted;
+    do {
+      submitted =
+          int(::syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0));
+    } while (submitted < 0 && errno == EINTR);
+    return submitted == 1 ? 0 : submitted < 0 ? -errno : -EAGAIN;
+  }
+
+  /**
+   * Waits for the next completion
+   * @return negative errno if waiting failed
+   */
+  int Wait(std::uint64_t &tag, long &result) noexcept {
+    unsigned head = *cq_head_;
+    while (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      if (::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS,
+                    nullptr, 0) < 0 &&
+          errno != EINTR) {
+        return -errno;
+      }
+    }
+    const auto &cqe = cqes_[head & cq_mask_];
+    tag = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return 0;
+  }
+
+ private:
+  bool SupportsRead() const noexcept {
+    constexpr unsigned kOps = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) +
+                             kOps * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+    // kernels before 5.6 have neither the probe nor IORING_OP_READ
+    return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE,
+                     probe, kOps) >= 0 &&
+           probe->last_op >= IORING_OP_READ &&
+           (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  int fd_ = -1;
+  void *sq_ = MAP_FAILED, *cq_ = MAP_FAILED, *sqes_ = MAP_FAILED;
+  std::size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+  unsigned *sq_tail_ = nullptr, *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr;
+  unsigned sq_mask_ = 0, cq_mask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+};
+#else
+class BlockReader::Ring {
+ public:
+  bool Setup(unsigned) noexcept { return false; }
+  int Read(int, char *, std::size_t, std::size_t, std::uint64_t) noexcept {
+    return -ENOSYS;
+  }
+  int Wait(std::uint64_t &, long &) noexcept { return -ENOSYS; }
+};
+#endif
+
+BlockReader::BlockReader() {
+  for (auto &slot : slots_) slot.data.resize(kBufferSize);
+}
+
+BlockReader::~BlockReader() { Close(); }
+
+BlockReader::Backend BlockReader::Best() noexcept {
+  static const Backend best =
+      Supported(Backend::kIoUring) ? Backend::kIoUring : Backend::kPread;
+  return best;
+}
+
+bool BlockReader::Supported(Backend backend) noexcept {
+  if (backend == Backend::kPread) return true;
+  static const bool supported = Ring().Setup(1);
+  return supported;
+}
+
+bool BlockReader::Open(const std::string &filename, Backend backend,
+                       bool direct) noexcept {
+  Close();
+  int fd = -1;
+#ifdef O_DIRECT
+  // not every file system takes O_DIRECT, those are read through the cache
+  if (direct) fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+  direct_ = fd >= 0;
+#endif
+  if (fd < 0) fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat info {};
+  if (::fstat(fd, &info) || !S_ISREG(info.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  if (backend == Backend::kIoUring) {
+    ring_ = std::make_unique<Ring>();
+    if (!ring_->Setup(unsigned(kDepth))) {
+      ring_.reset();
+      backend = Backend::kPread;
+    }
+  }
+  if (!direct_) ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  fd_ = fd;
+  backend_ = backend;
+  size_ = std::size_t(info.st_size);
+  for (std::size_t i = 0; i < kDepth; ++i) {
+    if (Start(slots_[i])) Submit(i);
+  }
+  return true;
+}
+
+void BlockReader::Close() noexcept {
+  // the kernel may still be writing into the buffers
+  if (ring_) {
+    auto pending = [this] {
+      return std::any_of(slots_.begin(), slots_.end(),
+                         [](const Slot &slot) { return slot.pending; });
+    };
+    std::uint64_t tag = 0;
+    long result = 0;
+    while (pending() && ring_->Wait(tag, result) == 0) {
+      if (tag < kDepth) slots_[tag].pending = false;
+    }
+    ring_.reset();
+  }
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+  for (auto &slot : slots_) slot.pending = slot.active = false;
+  current_ = next_offset_ = size_ = consumed_ = 0;
+  error_ = 0;
+  direct_ = false;
+}
+
+std::size_t BlockReader::Read(char *out, std::size_t size) {
+  std::size_t copied = 0;
+  while (copied < size && fd_ >= 0) {
+    auto &slot = slots_[current_];
+    if (!slot.active) break;
+    if (backend_ == Backend::kPread && !direct_ && !slot.filled &&
+        size - copied >= slot.expected) {
+      // nothing to align and nothing read ahead, straight to the caller
+      slot.filled = Fill(out + copied, slot.expected, slot.offset);
+      CheckError();
+      copied += slot.filled;
+      slot.active = false;
+      if (Start(slot)) Submit(current_);
+      current_ = (current_ + 1) % kDepth;
+      continue;
+    }
+    Wait(current_);
+    const auto count = std::min(size - copied, slot.filled - slot.taken);
+    std::memcpy(out + copied, slot.data.data() + slot.taken, count);
+    copied += count;
+    slot.taken += count;
+    if (slot.taken == slot.filled) {
+      slot.active = false;
+      if (Start(slot)) Submit(current_);
+      current_ = (current_ + 1) % kDepth;
+    }
+  }
+  consumed_ += copied;
+  return copied;
+}
+
+bool BlockReader::Start(Slot &slot) {
+  if (next_offset_ >= size_) return false;
+  slot.offset = next_offset_;
+  slot.expected = std::min(kBufferSize, size_ - next_offset_);
+  slot.filled = slot.taken = 0;
+  slot.active = true;
+  next_offset_ += kBufferSize;
+  return true;
+}
+
+void BlockReader::Submit(std::size_t index) {
+  auto &slot = slots_[index];
+  if (backend_ == Backend::kPread) return;
+  // the whole rest of the buffer, O_DIRECT wants aligned lengths and the
+  // file simply ends before the last one is full. Only the first read of a
+  // slot is submitted with O_DIRECT, see Finish
+  int status = ring_->Read(fd_, slot.data.data() + slot.filled,
+                           kBufferSize - slot.filled,
+                           slot.offset + slot.filled, index);
+  if (status < 0) {
+    error_ = -status;
+  } else {
+    slot.pending = true;
+  }
+}
+
+void BlockReader::Wait(std::size_t index) {
+  auto &slot = slots_[index];
+  while (!error_ && slot.filled < slot.expected) {
+    if (backend_ == Backend::kPread) {
+      // O_DIRECT wants the whole aligned buffer, the file ends before it
+      auto filled = Fill(slot.data.data(),
+                         direct_ ? kBufferSize : slot.expected, slot.offset);
+      slot.filled = std::min(filled, slot.expected);
+      break;
+    }
+    if (!slot.pending) break;
+    std::uint64_t tag = 0;
+    long result = 0;
+    if (int status = ring_->Wait(tag, result); status < 0) {
+      error_ = -status;
+    } else if (tag < kDepth) {
+      slots_[tag].pending = false;
+      Finish(std::size_t(tag), result);
+    }
+  }
+  CheckError();
+}
+
+void BlockReader::CheckError() const {
+  if (error_) {
+    throw std::runtime_error(std::string("Failed to read the file: ") +
+                             std::strerror(error_));
+  }
+}
+
+std::size_t BlockReader::Fill(char *data, std::size_t size,
+                              std::size_t offset) {
+  std::size_t filled = 0;
+  while (filled < size) {
+    // O_DIRECT takes aligned offsets only, a partial page is read again
+    const auto from = direct_ ? filled / kDirectAlign * kDirectAlign : filled;
+    ssize_t result =
+        ::pread(fd_, data + from, size - from, off_t(offset + from));
+    if (result < 0 && errno == EINTR) continue;
+    if (result < 0) {
+      error_ = errno;
+      break;
+    }
+    // no progress at the end of the file, also if it got shorter since it
+    // was opened
+    if (from + std::size_t(result) <= filled) break;
+    filled = from + std::size_t(result);
+  }
+  return filled;
+}
+
+void BlockReader::Finish(std::size_t index, long result) {
+  auto &slot = slots_[index];
+  if (result == -EINTR || result == -EAGAIN) {
+    Submit(index);
+  } else if (result < 0) {
+    error_ = int(-result);
+  } else if (result == 0) {
+    // the file got shorter since it was opened
+    slot.expected = slot.filled;
+  } else {
+    slot.filled = std::min(slot.filled + std::size_t(result), slot.expected);
+    if (slot.filled == slot.expected) return;
+    if (!direct_) {
+      Submit(index);
+      return;
+    }
+    const auto from = slot.filled / kDirectAlign * kDirectAlign;
+    slot.filled = std::min(
+        from + Fill(slot.data.data() + from, kBufferSize - from,
+                    slot.offset + from),
+        slot.expected);
+    // the file got shorter since it was opened
+    if (!error_) slot.expected = slot.filled;
+  }
+}
+
+}  // namespace s21
@@ -0,0 +1,166 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#include "Decompressor.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdexcept>
+#ifdef S21_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace s21 {
+
+namespace {
+
+// zlib counts bytes in uInt, larger requests are served in pieces
+constexpr std::size_t kMaxPiece = 1u << 30;
+
+bool EndsWith(const std::string &str, const std::string &suffix) noexcept {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * @class GzipDecompressor
+ * @brief gzip and zlib streams, concatenated gzip members included
+ */
+class GzipDecompressor : public Decompressor {
+ public:
+  explicit GzipDecompressor(std::istream &in) : Decompressor(in) {
+    // 32 lets zlib detect gzip or zlib headers
+    if (inflateInit2(&stream_, 15 + 32) != Z_OK) {
+      throw std::runtime_error("Failed to init decompression.");
+    }
+  }
+
+  ~GzipDecompressor() override { inflateEnd(&stream_); }
+
+  std::size_t Read(char *out, std::size_t size) override {
+    stream_.next_out = reinterpret_cast<Bytef *>(out);
+    stream_.avail_out = uInt(std::min(size, kMaxPiece));
+    const auto requested = stream_.avail_out;
+    while (stream_.avail_out && !finished_) {
+      if (!stream_.avail_in) {
+        stream_.next_in = reinterpret_cast<Bytef *>(input_.data());
+        stream_.avail_in = uInt(Fill());
+        if (!stream_.avail_in) {
+          if (in_member_) {
+            throw std::runtime_error("Unexpected end of compressed data.");
+          }
+          finished_ = true;
+          break;
+        }
+      }
+      in_member_ = true;
+      int status = inflate(&stream_, Z_NO_FLUSH);
+      if (status == Z_STREAM_END) {
+        in_member_ = false;
+        inflateReset(&stream_);
+      } else if (status != Z_OK && status != Z_BUF_ERROR) {
+        throw std::runtime_error("Corrupted compressed data.");
+      }
+    }
+    return requested - stream_.avail_out;
+  }
+
+ private:
+  z_stream stream_{};
+  bool in_member_ = false;
+  bool finished_ = false;
+};
+
+#ifdef S21_HAVE_ZSTD
+/**
+ * @class ZstdDecompressor
+ * @brief zstd streams, concatenated frames included
+ */
+class ZstdDecompressor : public Decompressor {
+ public:
+  explicit ZstdDecompressor(std::istream &in)
+      : Decompressor(in), stream_(ZSTD_createDStream()) {
+    if (!stream_) throw std::runtime_error("Failed to init decompression.");
+  }
+
+  ~ZstdDecompressor() override { ZSTD_freeDStream(stream_); }
+
+  std::size_t Read(char *out, std::size_t size) override {
+    ZSTD_outBuffer output{out, size, 0};
+    while (output.pos != output.size && !finished_) {
+      if (input_pos_ == input_size_) {
+        input_pos_ = 0;
+        input_size_ = Fill();
+        if (!input_size_) {
+          if (in_frame_) {
+            throw std::runtime_error("Unexpected end of compressed data.");
+          }
+          finished_ = true;
+          break;
+        }
+      }
+      ZSTD_inBuffer input{input_.data(), input_size_, input_pos_};
+      in_frame_ = true;
+      auto status = ZSTD_decompressStream(stream_, &output, &input);
+      input_pos_ = input.pos;
+      if (ZSTD_isError(status)) {
+        throw std::runtime_error("Corrupted compressed data.");
+      }
+      if (!status) in_frame_ = false;
+    }
+    return output.pos;
+  }
+
+ private:
+  ZSTD_DStream *stream_;
+  std::size_t input_pos_ = 0, input_size_ = 0;
+  bool in_frame_ = false;
+  bool finished_ = false;
+};
+#endif
+
+}  // namespace
+
+Decompressor::Format Decompressor::Detect(const char *data,
+                                          std::size_t size) noexcept {
+  auto *bytes = reinterpret_cast<const unsigned char *>(data);
+  if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) return Format::kGzip;
+  if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f &&
+      bytes[3] == 0xfd)
+    return Format::kZstd;
+  return Format::kPlain;
+}
+
+Decompressor::Format Decompressor::Detect(
+    const std::string &filename) noexcept {
+  if (EndsWith(filename, ".gz")) return Format::kGzip;
+  if (EndsWith(filename, ".zst")) return Format::kZstd;
+  return Format::kPlain;
+}
+
+std::unique_ptr<Decompressor> Decompressor::Create(Format format,
+                                                   std::istream &in) {
+  switch (format) {
+    case Format::kGzip:
+      return std::make_unique<GzipDecompressor>(in);
+    case Format::kZstd:
+#ifdef S21_HAVE_ZSTD
+      return std::make_unique<ZstdDecompressor>(in);
+#else
+      throw std::runtime_error("Built without zstd support.");
+#endif
+    default:
+      throw std::runtime_error("The file is not compressed.");
+  }
+}
+
+std::size_t Decompressor::Fill() {
+  in_.read(input_.data(), std::streamsize(input_.size()));
+  auto size = std::size_t(in_.gcount());
+  consumed_ += size;
+  return size;
+}
+
+}  // namespace s21
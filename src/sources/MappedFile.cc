@@ -0,0 +1,61 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace s21 {
+
+MappedFile::~MappedFile() { Unmap(); }
+
+bool MappedFile::Map(const std::string &filename, std::size_t min_size,
+                     bool huge_pages) noexcept {
+  Unmap();
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat info {};
+  void *data = MAP_FAILED;
+  if (!::fstat(fd, &info) && S_ISREG(info.st_mode) && info.st_size > 0 &&
+      std::size_t(info.st_size) >= min_size) {
+    data = ::mmap(nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE,
+                  fd, 0);
+  }
+  ::close(fd);
+  if (data == MAP_FAILED) return false;
+
+  size_ = std::size_t(info.st_size);
+  data_ = released_ = static_cast<const char *>(data);
+  ::madvise(data, size_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) ::madvise(data, size_, MADV_HUGEPAGE);
+#else
+  (void)huge_pages;
+#endif
+  return true;
+}
+
+void MappedFile::Unmap() noexcept {
+  if (data_) ::munmap(const_cast<char *>(data_), size_);
+  data_ = released_ = nullptr;
+  size_ = 0;
+}
+
+void MappedFile::Release(const char *upto) noexcept {
+  Evict(upto);
+  static const auto page = std::size_t(::sysconf(_SC_PAGESIZE));
+  released_ += std::size_t(upto - released_) / page * page;
+}
+
+void MappedFile::Evict(const char *upto) noexcept {
+  static const auto page = std::size_t(::sysconf(_SC_PAGESIZE));
+  auto length = std::size_t(upto - released_) / page * page;
+  // a private read-only mapping reloads dropped pages from the page cache
+  if (length) ::madvise(const_cast<char *>(released_), length, MADV_DONTNEED);
+}
+
+}  // namespace s21
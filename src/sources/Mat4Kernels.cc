@@ -0,0 +1,432 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#include "Mat4Kernels.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__GNUC__)
+#define S21_X86_DISPATCH
+#include <immintrin.h>
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+namespace s21 {
+
+namespace {
+
+bool AffineInverseScalar(const Mat4 &m, Mat4 &out) noexcept {
+  // the columns of the inverse are the cross products of the other rows
+  float cross[3][3];
+  for (int j = 0; j < 3; ++j) {
+    const int a = (j + 1) % 3, b = (j + 2) % 3;
+    cross[j][0] = m(a, 1) * m(b, 2) - m(a, 2) * m(b, 1);
+    cross[j][1] = m(a, 2) * m(b, 0) - m(a, 0) * m(b, 2);
+    cross[j][2] = m(a, 0) * m(b, 1) - m(a, 1) * m(b, 0);
+  }
+  const float det =
+      m(0, 0) * cross[0][0] + m(0, 1) * cross[0][1] + m(0, 2) * cross[0][2];
+  if (det == 0) return false;
+  Mat4 inverse;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) inverse(i, j) = cross[j][i] / det;
+  }
+  for (int j = 0; j < 3; ++j) {
+    inverse(3, j) = -(m(3, 0) * inverse(0, j) + m(3, 1) * inverse(1, j) +
+                      m(3, 2) * inverse(2, j));
+  }
+  inverse(3, 3) = 1;
+  out = inverse;
+  return true;
+}
+
+void TransformScalar(const Mat4 &m, const Vec4 *in, Vec4 *out,
+                     std::size_t count) noexcept {
+  for (std::size_t i = 0; i < count; ++i) out[i] = in[i] * m;
+}
+
+Mat4 ChainScalar(const Mat4Link *links, std::size_t count) noexcept {
+  auto factor = [links](std::size_t l) {
+    return links[l].transposed ? links[l].matrix->Transpose()
+                               : *links[l].matrix;
+  };
+  Mat4 result = factor(0);
+  for (std::size_t l = 1; l < count; ++l) result *= factor(l);
+  return result;
+}
+
+#ifdef __SSE2__
+inline __m128 LoadRow(const Mat4 &m, int i) noexcept {
+  return _mm_load_ps(m.GetPointer() + 4 * i);
+}
+
+/**
+ * Row vector v times the matrix with the given rows
+ */
+inline __m128 Combine(__m128 v, const __m128 (&rows)[4]) noexcept {
+  __m128 sum = _mm_mul_ps(_mm_shuffle_ps(v, v, 0x00), rows[0]);
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(v, v, 0x55), rows[1]));
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xAA), rows[2]));
+  return _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xFF), rows[3]));
+}
+
+Mat4 MultiplySse(const Mat4 &a, const Mat4 &b) noexcept {
+  const __m128 rows[4] = {LoadRow(b, 0), LoadRow(b, 1), LoadRow(b, 2),
+                          LoadRow(b, 3)};
+  Mat4 result;
+  for (int i = 0; i < 4; ++i) {
+    _mm_store_ps(result.GetPointer() + 4 * i, Combine(LoadRow(a, i), rows));
+  }
+  return result;
+}
+
+Mat4 TransposeSse(const Mat4 &m) noexcept {
+  __m128 r0 = LoadRow(m, 0), r1 = LoadRow(m, 1), r2 = LoadRow(m, 2),
+         r3 = LoadRow(m, 3);
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  Mat4 result;
+  float *out = result.GetPointer();
+  _mm_store_ps(out, r0);
+  _mm_store_ps(out + 4, r1);
+  _mm_store_ps(out + 8, r2);
+  _mm_store_ps(out + 12, r3);
+  return result;
+}
+
+/**
+ * Cross product of the x, y and z lanes, w comes out 0
+ */
+inline __m128 Cross(__m128 a, __m128 b) noexcept {
+  const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+  const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+  const __m128 zxy = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+  return _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+bool AffineInverseSse(const Mat4 &m, Mat4 &out) noexcept {
+  // the w lanes of the linear rows are 0 for an affine transform, cleared
+  // anyway so they don't leak into the products
+  const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  const __m128 r0 = _mm_and_ps(LoadRow(m, 0), xyz);
+  const __m128 r1 = _mm_and_ps(LoadRow(m, 1), xyz);
+  const __m128 r2 = _mm_and_ps(LoadRow(m, 2), xyz);
+  __m128 c0 = Cross(r1, r2), c1 = Cross(r2, r0), c2 = Cross(r0, r1);
+  alignas(16) float products[4];
+  _mm_store_ps(products, _mm_mul_ps(r0, c0));
+  const float det = products[0] + products[1] + products[2];
+  if (det == 0) return false;
+  __m128 c3 = _mm_setzero_ps();
+  _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+  const __m128 scale = _mm_set1_ps(det);
+  const __m128 rows[3] = {_mm_div_ps(c0, scale), _mm_div_ps(c1, scale),
+                          _mm_div_ps(c2, scale)};
+  const __m128 t = LoadRow(m, 3);
+  __m128 moved = _mm_mul_ps(_mm_shuffle_ps(t, t, 0x00), rows[0]);
+  moved = _mm_add_ps(moved, _mm_mul_ps(_mm_shuffle_ps(t, t, 0x55), rows[1]));
+  moved = _mm_add_ps(moved, _mm_mul_ps(_mm_shuffle_ps(t, t, 0xAA), rows[2]));
+  float *result = out.GetPointer();
+  _mm_store_ps(result, rows[0]);
+  _mm_store_ps(result + 4, rows[1]);
+  _mm_store_ps(result + 8, rows[2]);
+  _mm_store_ps(result + 12, _mm_sub_ps(_mm_setr_ps(0, 0, 0, 1), moved));
+  return true;
+}
+
+void TransformSse(const Mat4 &m, const Vec4 *in, Vec4 *out,
+                  std::size_t count) noexcept {
+  const __m128 rows[4] = {LoadRow(m, 0), LoadRow(m, 1), LoadRow(m, 2),
+                          LoadRow(m, 3)};
+  for (std::size_t i = 0; i < count; ++i) {
+    _mm_store_ps(out[i].v, Combine(_mm_load_ps(in[i].v), rows));
+  }
+}
+
+/**
+ * Rows of a chain factor as it is multiplied
+ */
+inline void LoadLink(const Mat4Link &link, __m128 (&rows)[4]) noexcept {
+  for (int i = 0; i < 4; ++i) rows[i] = LoadRow(*link.matrix, i);
+  if (link.transposed) _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+}
+
+Mat4 ChainSse(const Mat4Link *links, std::size_t count) noexcept {
+  __m128 product[4], rows[4];
+  LoadLink(links[0], product);
+  for (std::size_t l = 1; l < count; ++l) {
+    LoadLink(links[l], rows);
+    for (int i = 0; i < 4; ++i) product[i] = Combine(product[i], rows);
+  }
+  Mat4 result;
+  for (int i = 0; i < 4; ++i) {
+    _mm_store_ps(result.GetPointer() + 4 * i, product[i]);
+  }
+  return result;
+}
+#endif
+
+#ifdef S21_X86_DISPATCH
+/**
+ * Two row vectors, one per 128-bit lane, times the matrix whose rows are
+ * repeated in both lanes
+ */
+__attribute__((target("avx"))) inline __m256 CombinePair(
+    __m256 v, const __m256 (&rows)[4]) noexcept {
+  __m256 sum = _mm256_mul_ps(_mm256_permute_ps(v, 0x00), rows[0]);
+  sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_permute_ps(v, 0x55), rows[1]));
+  sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_permute_ps(v, 0xAA), rows[2]));
+  return _mm256_add_ps(sum,
+                       _mm256_mul_ps(_mm256_permute_ps(v, 0xFF), rows[3]));
+}
+
+__attribute__((target("avx"))) inline void BroadcastRows(
+    const Mat4 &m, __m256 (&rows)[4]) noexcept {
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = _mm256_broadcast_ps(
+        reinterpret_cast<const __m128 *>(m.GetPointer() + 4 * i));
+  }
+}
+
+__attribute__((target("avx"))) Mat4 MultiplyAvx(const Mat4 &a,
+                                               const Mat4 &b) noexcept {
+  __m256 rows[4];
+  BroadcastRows(b, rows);
+  Mat4 result;
+  // Mat4 is only 16-byte aligned, the halves are loaded unaligned
+  for (int i = 0; i < 4; i += 2) {
+    _mm256_storeu_ps(
+        result.GetPointer() + 4 * i,
+        CombinePair(_mm256_loadu_ps(a.GetPointer() + 4 * i), rows));
+  }
+  return result;
+}
+
+__attribute__((target("avx"))) void TransformAvx(const Mat4 &m,
+                                                 const Vec4 *in, Vec4 *out,
+                                                 std::size_t count) noexcept {
+  __m256 rows[4];
+  BroadcastRows(m, rows);
+  std::size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    _mm256_storeu_ps(out[i].v, CombinePair(_mm256_loadu_ps(in[i].v), rows));
+  }
+  if (i != count) {
+    // the last vector alone, in the low lane
+    __m256 last = _mm256_castps128_ps256(_mm_load_ps(in[i].v));
+    _mm_store_ps(out[i].v,
+                 _mm256_castps256_ps128(CombinePair(last, rows)));
+  }
+}
+
+__attribute__((target("avx"))) Mat4 ChainAvx(const Mat4Link *links,
+                                             std::size_t count) noexcept {
+  __m128 rows[4];
+  LoadLink(links[0], rows);
+  __m256 product[2] = {_mm256_set_m128(rows[1], rows[0]),
+                       _mm256_set_m128(rows[3], rows[2])};
+  for (std::size_t l = 1; l < count; ++l) {
+    LoadLink(links[l], rows);
+    __m256 pairs[4];
+    for (int i = 0; i < 4; ++i) pairs[i] = _mm256_set_m128(rows[i], rows[i]);
+    product[0] = CombinePair(product[0], pairs);
+    product[1] = CombinePair(product[1], pairs);
+  }
+  Mat4 result;
+  _mm256_storeu_ps(result.GetPointer(), product[0]);
+  _mm256_storeu_ps(result.GetPointer() + 8, product[1]);
+  return result;
+}
+#endif
+
+#ifdef __ARM_NEON
+inline float32x4_t CombineNeon(float32x4_t v,
+                               const float32x4_t (&rows)[4]) noexcept {
+  float32x4_t sum = vmulq_n_f32(rows[0], vgetq_lane_f32(v, 0));
+  sum = vaddq_f32(sum, vmulq_n_f32(rows[1], vgetq_lane_f32(v, 1)));
+  sum = vaddq_f32(sum, vmulq_n_f32(rows[2], vgetq_lane_f32(v, 2)));
+  return vaddq_f32(sum, vmulq_n_f32(rows[3], vgetq_lane_f32(v, 3)));
+}
+
+inline void LoadRowsNeon(const Mat4 &m, float32x4_t (&rows)[4]) noexcept {
+  for (int i = 0; i < 4; ++i) rows[i] = vld1q_f32(m.GetPointer() + 4 * i);
+}
+
+Mat4 MultiplyNeon(const Mat4 &a, const Mat4 &b) noexcept {
+  float32x4_t rows[4];
+  LoadRowsNeon(b, rows);
+  Mat4 result;
+  for (int i = 0; i < 4; ++i) {
+    vst1q_f32(result.GetPointer() + 4 * i,
+              CombineNeon(vld1q_f32(a.GetPointer() + 4 * i), rows));
+  }
+  return result;
+}
+
+Mat4 TransposeNeon(const Mat4 &m) noexcept {
+  // the interleaved load reads the columns
+  const float32x4x4_t columns = vld4q_f32(m.GetPointer());
+  Mat4 result;
+  for (int i = 0; i < 4; ++i) {
+    vst1q_f32(result.GetPointer() + 4 * i, columns.val[i]);
+  }
+  return result;
+}
+
+inline void LoadLinkNeon(const Mat4Link &link,
+                         float32x4_t (&rows)[4]) noexcept {
+  if (!link.transposed) return LoadRowsNeon(*link.matrix, rows);
+  const float32x4x4_t columns = vld4q_f32(link.matrix->GetPointer());
+  for (int i = 0; i < 4; ++i) rows[i] = columns.val[i];
+}
+
+Mat4 ChainNeon(const Mat4Link *links, std::size_t count) noexcept {
+  float32x4_t product[4], rows[4];
+  LoadLinkNeon(links[0], product);
+  for (std::size_t l = 1; l < count; ++l) {
+    LoadLinkNeon(links[l], rows);
+    for (int i = 0; i < 4; ++i) product[i] = CombineNeon(product[i], rows);
+  }
+  Mat4 result;
+  for (int i = 0; i < 4; ++i) {
+    vst1q_f32(result.GetPointer() + 4 * i, product[i]);
+  }
+  return result;
+}
+
+void TransformNeon(const Mat4 &m, const Vec4 *in, Vec4 *out,
+                   std::size_t count) noexcept {
+  float32x4_t rows[4];
+  LoadRowsNeon(m, rows);
+  for (std::size_t i = 0; i < count; ++i) {
+    vst1q_f32(out[i].v, CombineNeon(vld1q_f32(in[i].v), rows));
+  }
+}
+#endif
+
+}  // namespace
+
+Mat4Kernels::Isa Mat4Kernels::Best() noexcept {
+  static const Isa best = Supported(Isa::kAvx)    ? Isa::kAvx
+                          : Supported(Isa::kSse)  ? Isa::kSse
+                          : Supported(Isa::kNeon) ? Isa::kNeon
+                                                  : Isa::kScalar;
+  return best;
+}
+
+bool Mat4Kernels::Supported(Isa isa) noexcept {
+  switch (isa) {
+#ifdef __SSE2__
+    case Isa::kSse:
+      return true;
+#endif
+#ifdef S21_X86_DISPATCH
+    case Isa::kAvx:
+      return __builtin_cpu_supports("avx");
+#endif
+#ifdef __ARM_NEON
+    case Isa::kNeon:
+      return true;
+#endif
+    case Isa::kScalar:
+      return true;
+    default:
+      return false;
+  }
+}
+
+Mat4 Mat4Kernels::Multiply(const Mat4 &a, const Mat4 &b, Isa isa) noexcept {
+  switch (isa) {
+#ifdef S21_X86_DISPATCH
+    case Isa::kAvx:
+      return MultiplyAvx(a, b);
+#endif
+#ifdef __SSE2__
+    case Isa::kSse:
+      return MultiplySse(a, b);
+#endif
+#ifdef __ARM_NEON
+    case Isa::kNeon:
+      return MultiplyNeon(a, b);
+#endif
+    default:
+      return a * b;
+  }
+}
+
+Mat4 Mat4Kernels::Transpose(const Mat4 &m, Isa isa) noexcept {
+  switch (isa) {
+#ifdef __SSE2__
+    // a 4x4 transpose gains nothing from 256-bit registers
+    case Isa::kAvx:
+    case Isa::kSse:
+      return TransposeSse(m);
+#endif
+#ifdef __ARM_NEON
+    case Isa::kNeon:
+      return TransposeNeon(m);
+#endif
+    default:
+      return m.Transpose();
+  }
+}
+
+bool Mat4Kernels::AffineInverse(const Mat4 &m, Mat4 &out, Isa isa) noexcept {
+  switch (isa) {
+#ifdef __SSE2__
+    case Isa::kAvx:
+    case Isa::kSse:
+      return AffineInverseSse(m, out);
+#endif
+    default:
+      return AffineInverseScalar(m, out);
+  }
+}
+
+Mat4 Mat4Kernels::Chain(const Mat4Link *links, std::size_t count,
+                        Isa isa) noexcept {
+  switch (isa) {
+#ifdef S21_X86_DISPATCH
+    case Isa::kAvx:
+      return ChainAvx(links, count);
+#endif
+#ifdef __SSE2__
+    case Isa::kSse:
+      return ChainSse(links, count);
+#endif
+#ifdef __ARM_NEON
+    case Isa::kNeon:
+      return ChainNeon(links, count);
+#endif
+    default:
+      return ChainScalar(links, count);
+  }
+}
+
+void Mat4Kernels::Transform(const Mat4 &m, const Vec4 *in, Vec4 *out,
+                            std::size_t count, Isa isa) noexcept {
+  switch (isa) {
+#ifdef S21_X86_DISPATCH
+    case Isa::kAvx:
+      TransformAvx(m, in, out, count);
+      break;
+#endif
+#ifdef __SSE2__
+    case Isa::kSse:
+      TransformSse(m, in, out, count);
+      break;
+#endif
+#ifdef __ARM_NEON
+    case Isa::kNeon:
+      TransformNeon(m, in, out, count);
+      break;
+#endif
+    default:
+      TransformScalar(m, in, out, count);
+  }
+}
+
+}  // namespace s21
@@ -0,0 +1,421 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#include "MeshCache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Model.h"
+
+namespace s21 {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr char kMagic[8] = {'S', '2', '1', 'M', 'E', 'S', 'H', '\0'};
+constexpr std::size_t kBufferSize = 1 << 20;
+// zlib counts bytes in uInt, larger arrays are fed in pieces
+constexpr std::size_t kMaxPiece = 1u << 30;
+// deflate can't shrink data more than about 1032 times
+constexpr std::uint64_t kMaxDeflateRatio = 1032;
+constexpr std::uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+/**
+ * @struct Span
+ * @brief raw byte range of an array
+ */
+struct Span {
+  unsigned char *data;
+  std::size_t size;
+};
+
+std::uint64_t Rotl(std::uint64_t num, int bits) noexcept {
+  return (num << bits) | (num >> (64 - bits));
+}
+
+/**
+ * Streams parts through deflate into out
+ * @param written - compressed size
+ */
+bool Deflate(std::ostream &out, std::vector<Span> parts,
+             std::uint64_t &written) {
+  z_stream stream{};
+  if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) return false;
+  std::vector<unsigned char> buffer(kBufferSize);
+  std::size_t part = 0;
+  int status = Z_OK;
+  while (status == Z_OK && out) {
+    while (!stream.avail_in && part != parts.size()) {
+      auto &span = parts[part];
+      auto piece = std::min(span.size, kMaxPiece);
+      stream.next_in = span.data;
+      stream.avail_in = uInt(piece);
+      span.data += piece;
+      span.size -= piece;
+      if (!span.size) ++part;
+    }
+    stream.next_out = buffer.data();
+    stream.avail_out = uInt(buffer.size());
+    status = deflate(&stream, part == parts.size() ? Z_FINISH : Z_NO_FLUSH);
+    auto size = buffer.size() - stream.avail_out;
+    out.write(reinterpret_cast<const char *>(buffer.data()),
+              std::streamsize(size));
+    written += size;
+  }
+  deflateEnd(&stream);
+  return status == Z_STREAM_END && out;
+}
+
+/**
+ * Inflates in straight into the parts, they must be filled exactly
+ */
+bool Inflate(Span in, std::vector<Span> parts) {
+  z_stream stream{};
+  if (inflateInit(&stream) != Z_OK) return false;
+  std::size_t part = 0;
+  int status = Z_OK;
+  while (status == Z_OK) {
+    if (!stream.avail_in && in.size) {
+      auto piece = std::min(in.size, kMaxPiece);
+      stream.next_in = in.data;
+      stream.avail_in = uInt(piece);
+      in.data += piece;
+      in.size -= piece;
+    }
+    while (!stream.avail_out && part != parts.size()) {
+      auto &span = parts[part];
+      auto piece = std::min(span.size, kMaxPiece);
+      stream.next_out = span.data;
+      stream.avail_out = uInt(piece);
+      span.data += piece;
+      span.size -= piece;
+      if (!span.size) ++part;
+    }
+    status = inflate(&stream, Z_NO_FLUSH);
+  }
+  inflateEnd(&stream);
+  return status == Z_STREAM_END && !stream.avail_out &&
+         part == parts.size() && !in.size && !stream.avail_in;
+}
+
+/**
+ * @struct GroupRecord
+ * @brief fixed part of a stored group, follows its name
+ */
+struct GroupRecord {
+  std::uint64_t first;
+  std::uint64_t count;
+  std::uint32_t first_vertex;
+  std::uint32_t vertex_count;
+  float lower[3];
+  float upper[3];
+  float radius;
+};
+
+/**
+ * Serializes groups as name size, name and GroupRecord each
+ */
+std::vector<unsigned char> PackGroups(const std::vector<Group> &groups) {
+  std::vector<unsigned char> bytes;
+  for (const auto &group : groups) {
+    auto name_size = std::uint32_t(group.name.size());
+    GroupRecord record{group.first,        group.count,
+                       group.first_vertex, group.vertex_count,
+                       {},                 {},
+                       group.bounds.radius};
+    std::copy_n(group.bounds.lower.begin(), 3, record.lower);
+    std::copy_n(group.bounds.upper.begin(), 3, record.upper);
+    auto *size_bytes = reinterpret_cast<const unsigned char *>(&name_size);
+    auto *record_bytes = reinterpret_cast<const unsigned char *>(&record);
+    bytes.insert(bytes.end(), size_bytes, size_bytes + sizeof(name_size));
+    bytes.insert(bytes.end(), group.name.begin(), group.name.end());
+    bytes.insert(bytes.end(), record_bytes, record_bytes + sizeof(record));
+  }
+  return bytes;
+}
+
+bool UnpackGroups(const std::vector<unsigned char> &bytes,
+                  std::vector<Group> &groups) {
+  for (std::size_t pos = 0; pos != bytes.size();) {
+    std::uint32_t name_size;
+    if (bytes.size() - pos < sizeof(name_size)) return false;
+    std::memcpy(&name_size, &bytes[pos], sizeof(name_size));
+    pos += sizeof(name_size);
+    if (bytes.size() - pos < name_size + sizeof(GroupRecord)) return false;
+    Group group;
+    group.name.assign(reinterpret_cast<const char *>(&bytes[pos]), name_size);
+    pos += name_size;
+    GroupRecord record;
+    std::memcpy(&record, &bytes[pos], sizeof(record));
+    pos += sizeof(record);
+    group.first = record.first;
+    group.count = record.count;
+    group.first_vertex = record.first_vertex;
+    group.vertex_count = record.vertex_count;
+    std::copy_n(record.lower, 3, group.bounds.lower.begin());
+    std::copy_n(record.upper, 3, group.bounds.upper.begin());
+    group.bounds.radius = record.radius;
+    groups.push_back(std::move(group));
+  }
+  return true;
+}
+
+/**
+ * Checks the array sizes of header against its payload before anything is
+ * allocated, a plain payload holds exactly the arrays and a deflated one
+ * can't expand past the deflate ratio
+ */
+bool FitsPayload(const MeshCache::Header &header) noexcept {
+  constexpr auto kMax = std::numeric_limits<std::uint64_t>::max();
+  if (header.vertex_count % 3 || header.index_count % 2 ||
+      header.vertex_count > kMax / sizeof(float) ||
+      header.index_count > kMax / sizeof(unsigned))
+    return false;
+  const std::uint64_t vertex_bytes = header.vertex_count * sizeof(float);
+  const std::uint64_t index_bytes = header.index_count * sizeof(unsigned);
+  if (index_bytes > kMax - vertex_bytes ||
+      header.group_bytes > kMax - vertex_bytes - index_bytes)
+    return false;
+  const auto bytes = vertex_bytes + index_bytes + header.group_bytes;
+  if (!(header.flags & MeshCache::kCompressed)) {
+    return bytes == header.payload_size;
+  }
+  return header.payload_size <= kMax / kMaxDeflateRatio &&
+         bytes <= header.payload_size * kMaxDeflateRatio &&
+         bytes <= std::numeric_limits<std::size_t>::max();
+}
+
+std::int64_t MtimeOf(const struct stat &info) noexcept {
+  return std::int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+}  // namespace
+
+MeshCache::MeshCache(std::string dir, std::uintmax_t limit, bool compress,
+                     std::uint64_t variant)
+    : dir_(std::move(dir)),
+      limit_(limit),
+      compress_(compress),
+      variant_(variant) {
+  if (dir_.empty()) {
+    if (const char *cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+      dir_ = std::string(cache) + "/3dViewer";
+    } else if (const char *home = std::getenv("HOME"); home && *home) {
+      dir_ = std::string(home) + "/.cache/3dViewer";
+    }
+  }
+}
+
+bool MeshCache::Load(const std::string &filename, Obj &result) noexcept {
+  try {
+    return LoadEntry(filename, result);
+  } catch (...) {
+    return false;
+  }
+}
+
+bool MeshCache::LoadEntry(const std::string &filename, Obj &result) {
+  if (dir_.empty()) return false;
+  auto path = EntryPath(filename);
+  MappedFile entry;
+  if (!entry.Map(path, sizeof(Header))) return false;
+  Header header{};
+  std::memcpy(&header, entry.begin(), sizeof(Header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) ||
+      header.version != kVersion || header.variant != variant_ ||
+      header.payload_size != entry.size() - sizeof(Header) ||
+      !FitsPayload(header))
+    return false;
+  if (!Describe(filename, false) ||
+      header.source_size != source_.source_size ||
+      header.source_mtime != source_.source_mtime ||
+      !Describe(filename, true) || header.source_hash != source_.source_hash)
+    return false;
+
+  auto vertexes = std::make_unique<vertex>(header.vertex_count);
+  auto facetes = std::make_unique<facet>(header.index_count);
+  Span vertex_span{reinterpret_cast<unsigned char *>(vertexes->data()),
+                   vertexes->size() * sizeof(float)};
+  Span facet_span{reinterpret_cast<unsigned char *>(facetes->data()),
+                  facetes->size() * sizeof(unsigned)};
+  std::vector<unsigned char> group_bytes(header.group_bytes);
+  Span group_span{group_bytes.data(), group_bytes.size()};
+  auto *payload = reinterpret_cast<const unsigned char *>(entry.begin()) +
+                  sizeof(Header);
+  if (header.flags & kCompressed) {
+    if (!Inflate({const_cast<unsigned char *>(payload), header.payload_size},
+                 {vertex_span, facet_span, group_span}))
+      return false;
+  } else {
+    for (auto &span : {vertex_span, facet_span, group_span}) {
+      std::copy_n(payload, span.size, span.data);
+      payload += span.size;
+    }
+  }
+  std::vector<Group> groups;
+  if (!UnpackGroups(group_bytes, groups)) return false;
+
+  result.vertexes = std::move(vertexes);
+  result.facetes = std::move(facetes);
+  std::copy_n(header.lower, 3, result.bounds.lower.begin());
+  std::copy_n(header.upper, 3, result.bounds.upper.begin());
+  result.bounds.radius = header.radius;
+  result.min = *std::min_element(header.lower, header.lower + 3);
+  result.max = *std::max_element(header.upper, header.upper + 3);
+  result.welded = header.welded;
+  result.groups = std::move(groups);
+  // the entry mtime is its last use for eviction
+  std::error_code error;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+void MeshCache::Store(const std::string &filename, const Obj &result) noexcept {
+  try {
+    if (dir_.empty() || !Describe(filename, true)) return;
+    fs::create_directories(dir_);
+    auto path = EntryPath(filename);
+    auto temp = path + ".tmp" + std::to_string(::getpid());
+
+    Header header = source_;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.flags = compress_ ? kCompressed : 0;
+    header.variant = variant_;
+    header.reserved = 0;
+    header.vertex_count = result.vertexes->size();
+    header.index_count = result.facetes->size();
+    header.welded = result.welded;
+    std::copy_n(result.bounds.lower.begin(), 3, header.lower);
+    std::copy_n(result.bounds.upper.begin(), 3, header.upper);
+    header.radius = result.bounds.radius;
+    header.padding = 0;
+    Span vertex_span{
+        reinterpret_cast<unsigned char *>(result.vertexes->data()),
+        result.vertexes->size() * sizeof(float)};
+    Span facet_span{reinterpret_cast<unsigned char *>(result.facetes->data()),
+                    result.facetes->size() * sizeof(unsigned)};
+    auto group_bytes = PackGroups(result.groups);
+    header.group_bytes = group_bytes.size();
+    Span group_span{group_bytes.data(), group_bytes.size()};
+
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    bool written = true;
+    if (compress_) {
+      written = Deflate(out, {vertex_span, facet_span, group_span},
+                        header.payload_size);
+    } else {
+      header.payload_size = 0;
+      for (auto &span : {vertex_span, facet_span, group_span}) {
+        out.write(reinterpret_cast<const char *>(span.data),
+                  std::streamsize(span.size));
+        header.payload_size += span.size;
+      }
+    }
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    out.close();
+    if (!written || !out) {
+      fs::remove(temp);
+      return;
+    }
+    fs::rename(temp, path);
+    Evict();
+  } catch (...) {
+  }
+}
+
+std::uint64_t MeshCache::Hash(const char *data, std::size_t size) noexcept {
+  std::uint64_t lanes[4] = {kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1};
+  const char *end = data + size;
+  for (; end - data >= 32; data += 32) {
+    for (int i = 0; i < 4; ++i) {
+      std::uint64_t word;
+      std::memcpy(&word, data + 8 * i, 8);
+      lanes[i] = Rotl(lanes[i] + word * kPrime2, 31) * kPrime1;
+    }
+  }
+  std::uint64_t hash = Rotl(lanes[0], 1) + Rotl(lanes[1], 7) +
+                       Rotl(lanes[2], 12) + Rotl(lanes[3], 18) + size;
+  for (; data != end; ++data) {
+    hash = Rotl(hash ^ (std::uint64_t(std::uint8_t(*data)) * kPrime1), 11) *
+           kPrime2;
+  }
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime1;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+bool MeshCache::Describe(const std::string &filename, bool with_hash) {
+  if (!described_) {
+    struct stat info {};
+    if (::stat(filename.c_str(), &info) || !S_ISREG(info.st_mode)) return false;
+    source_.source_size = std::uint64_t(info.st_size);
+    source_.source_mtime = MtimeOf(info);
+    described_ = true;
+  }
+  if (with_hash && !hashed_) {
+    MappedFile source;
+    if (!source.Map(filename)) return false;
+    source_.source_hash = Hash(source.begin(), source.size());
+    hashed_ = true;
+  }
+  return true;
+}
+
+std::string MeshCache::EntryPath(const std::string &filename) const {
+  std::error_code error;
+  auto absolute = fs::absolute(filename, error).lexically_normal().string();
+  char name[24];
+  std::snprintf(name, sizeof(name), "%016llx.mesh",
+                static_cast<unsigned long long>(
+                    Hash(absolute.data(), absolute.size())));
+  return dir_ + "/" + name;
+}
+
+void MeshCache::Evict() noexcept {
+  struct Entry {
+    fs::file_time_type time;
+    std::uintmax_t size;
+    fs::path path;
+  };
+  std::vector<Entry> entries;
+  std::uintmax_t total = 0;
+  std::error_code error;
+  for (auto &file : fs::directory_iterator(dir_, error)) {
+    if (file.path().extension() != ".mesh") continue;
+    Entry entry{file.last_write_time(error), file.file_size(error),
+                file.path()};
+    if (error) continue;
+    total += entry.size;
+    entries.push_back(std::move(entry));
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.time < b.time; });
+  for (auto &entry : entries) {
+    if (total <= limit_) break;
+    if (fs::remove(entry.path, error)) total -= entry.size;
+  }
+}
+
+}  // namespace s21
@@ -0,0 +1,569 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#include "MeshLoader.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "Model.h"
+
+namespace s21 {
+
+namespace {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool kLittleEndian = false;
+#else
+constexpr bool kLittleEndian = true;
+#endif
+
+/// largest vertex count whose 1-based indices fit in unsigned
+constexpr std::size_t kMaxVertexes = std::numeric_limits<unsigned>::max() - 1;
+
+[[noreturn]] void ThrowWrongData() {
+  throw std::runtime_error("Wrong data in the file.");
+}
+
+bool HasExtension(const std::string &filename, const char *extension) noexcept {
+  const std::size_t size = std::strlen(extension);
+  return filename.size() >= size &&
+         std::equal(filename.end() - std::ptrdiff_t(size), filename.end(),
+                    extension, [](char c, char lower) {
+                      return std::tolower(static_cast<unsigned char>(c)) ==
+                             lower;
+                    });
+}
+
+/**
+ * Reads a little-endian value from possibly unaligned memory
+ */
+template <class T>
+T ReadLittle(const char *pos) noexcept {
+  T value;
+  if constexpr (kLittleEndian) {
+    std::memcpy(&value, pos, sizeof(T));
+  } else {
+    char bytes[sizeof(T)];
+    std::reverse_copy(pos, pos + sizeof(T), bytes);
+    std::memcpy(&value, bytes, sizeof(T));
+  }
+  return value;
+}
+
+/**
+ * Copies count little-endian floats, a plain memcpy on little-endian hosts
+ */
+void ReadFloats(const char *pos, std::size_t count, float *out) noexcept {
+  if constexpr (kLittleEndian) {
+    std::memcpy(out, pos, count * sizeof(float));
+  } else {
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = ReadLittle<float>(pos + i * sizeof(float));
+    }
+  }
+}
+
+/**
+ * @class StlLoader
+ * @brief binary STL: an 80 byte header, a triangle count, then a normal,
+ * three corners and 2 attribute bytes per triangle. Every triangle has its
+ * own copies of its corners, they are welded afterwards
+ */
+class StlLoader : public MeshLoader {
+ public:
+  [[nodiscard]] const char *Name() const noexcept override { return "STL"; }
+
+  [[nodiscard]] bool Accepts(const std::string &filename, const char *head,
+                             std::size_t size,
+                             std::size_t file_size) const noexcept override {
+    if (HasExtension(filename, ".stl")) return true;
+    // there is no magic, but the size follows from the count
+    return size >= kHeader &&
+           file_size == kHeader + kTriangle * ReadLittle<std::uint32_t>(
+                                                  head + kHeader - 4);
+  }
+
+  void Load(const char *data, std::size_t size, Obj &result) const override {
+    const bool text = size >= 5 && std::memcmp(data, "solid", 5) == 0;
+    const std::size_t count =
+        size < kHeader ? 0 : ReadLittle<std::uint32_t>(data + kHeader - 4);
+    if (size < kHeader || (size - kHeader) / kTriangle < count) {
+      if (text) {
+        throw std::runtime_error("Only binary STL files are supported.");
+      }
+      ThrowWrongData();
+    }
+    if (count > kMaxVertexes / 3) {
+      throw std::runtime_error("The mesh has too many vertices.");
+    }
+    auto &vertexes = *result.vertexes;
+    auto &facetes = *result.facetes;
+    vertexes.resize(9 * count);
+    facetes.resize(6 * count);
+    const char *pos = data + kHeader + kNormal;
+    float *position = vertexes.data();
+    unsigned *edge = facetes.data();
+    for (std::size_t i = 0; i < count; ++i, pos += kTriangle) {
+      ReadFloats(pos, 9, position);
+      position += 9;
+      const auto first = unsigned(3 * i + 1);
+      const unsigned edges[] = {first,     first + 1, first + 1,
+                                first + 2, first + 2, first};
+      edge = std::copy(std::begin(edges), std::end(edges), edge);
+    }
+  }
+
+  [[nodiscard]] bool Welds() const noexcept override { return true; }
+
+ private:
+  static constexpr std::size_t kHeader = 84;
+  static constexpr std::size_t kNormal = 12;
+  static constexpr std::size_t kTriangle = 50;
+};
+
+/**
+ * @enum PlyType
+ * @brief scalar types of PLY properties, kNone marks a missing one
+ */
+enum class PlyType {
+  kNone,
+  kInt8,
+  kUint8,
+  kInt16,
+  kUint16,
+  kInt32,
+  kUint32,
+  kFloat32,
+  kFloat64
+};
+
+PlyType PlyTypeOf(const std::string &name) noexcept {
+  static const std::pair<const char *, PlyType> kNames[] = {
+      {"char", PlyType::kInt8},      {"int8", PlyType::kInt8},
+      {"uchar", PlyType::kUint8},    {"uint8", PlyType::kUint8},
+      {"short", PlyType::kInt16},    {"int16", PlyType::kInt16},
+      {"ushort", PlyType::kUint16},  {"uint16", PlyType::kUint16},
+      {"int", PlyType::kInt32},      {"int32", PlyType::kInt32},
+      {"uint", PlyType::kUint32},    {"uint32", PlyType::kUint32},
+      {"float", PlyType::kFloat32},  {"float32", PlyType::kFloat32},
+      {"double", PlyType::kFloat64}, {"float64", PlyType::kFloat64}};
+  for (const auto &[word, type] : kNames) {
+    if (name == word) return type;
+  }
+  return PlyType::kNone;
+}
+
+bool IsInteger(PlyType type) noexcept {
+  return type != PlyType::kNone && type != PlyType::kFloat32 &&
+         type != PlyType::kFloat64;
+}
+
+/**
+ * Calls visit with a value of the C++ type of an integer PLY type
+ */
+template <class Visit>
+decltype(auto) VisitInteger(PlyType type, Visit visit) {
+  switch (type) {
+    case PlyType::kInt8:
+      return visit(std::int8_t());
+    case PlyType::kUint8:
+      return visit(std::uint8_t());
+    case PlyType::kInt16:
+      return visit(std::int16_t());
+    case PlyType::kUint16:
+      return visit(std::uint16_t());
+    case PlyType::kInt32:
+      return visit(std::int32_t());
+    default:
+      return visit(std::uint32_t());
+  }
+}
+
+/**
+ * VisitInteger for any PLY type
+ */
+template <class Visit>
+decltype(auto) VisitType(PlyType type, Visit visit) {
+  if (type == PlyType::kFloat32) return visit(float());
+  if (type == PlyType::kFloat64) return visit(double());
+  return VisitInteger(type, visit);
+}
+
+std::size_t SizeOf(PlyType type) {
+  return VisitType(type, [](auto value) { return sizeof(value); });
+}
+
+/**
+ * @struct PlyProperty
+ * @brief a scalar property or, if count is set, a list of them
+ */
+struct PlyProperty {
+  std::string name;
+  PlyType type = PlyType::kNone;
+  PlyType count = PlyType::kNone;
+};
+
+struct PlyElement {
+  std::string name;
+  std::size_t count = 0;
+  std::vector<PlyProperty> properties;
+
+  /**
+   * @return position of the named scalar property, properties.size() if
+   * there is none
+   */
+  [[nodiscard]] std::size_t Find(const char *property) const noexcept {
+    std::size_t i = 0;
+    while (i != properties.size() &&
+           (properties[i].name != property ||
+            properties[i].count != PlyType::kNone)) {
+      ++i;
+    }
+    return i;
+  }
+
+  /**
+   * @return bytes per element, 0 if it has lists
+   */
+  [[nodiscard]] std::size_t Stride() const {
+    std::size_t stride = 0;
+    for (const auto &property : properties) {
+      if (property.count != PlyType::kNone) return 0;
+      stride += SizeOf(property.type);
+    }
+    return stride;
+  }
+};
+
+/**
+ * @return bytes from data to the body, the elements in file order
+ * @throw std::runtime_error unless the header is complete and describes a
+ * binary little-endian file
+ */
+std::size_t ParsePlyHeader(const char *data, std::size_t size,
+                           std::vector<PlyElement> &elements) {
+  const char *pos = data, *end = data + size;
+  bool format = false;
+  for (bool first = true;; first = false) {
+    const char *eol = std::find(pos, end, '\n');
+    if (eol == end) ThrowWrongData();
+    std::string line(pos, eol);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    pos = eol + 1;
+    std::istringstream words(line);
+    std::string word;
+    words >> word;
+    if (first) {
+      if (line != "ply") ThrowWrongData();
+    } else if (word == "format") {
+      words >> word;
+      if (word != "binary_little_endian") {
+        throw std::runtime_error(
+            "Only binary little-endian PLY files are supported.");
+      }
+      format = true;
+    } else if (word == "element") {
+      PlyElement element;
+      if (!(words >> element.name >> element.count)) ThrowWrongData();
+      elements.push_back(std::move(element));
+    } else if (word == "property") {
+      PlyProperty property;
+      words >> word;
+      if (word == "list") {
+        words >> word;
+        property.count = PlyTypeOf(word);
+        if (!IsInteger(property.count)) ThrowWrongData();
+        words >> word;
+      }
+      property.type = PlyTypeOf(word);
+      if (elements.empty() || property.type == PlyType::kNone ||
+          !(words >> property.name)) {
+        ThrowWrongData();
+      }
+      elements.back().properties.push_back(std::move(property));
+    } else if (word == "end_header") {
+      break;
+    }
+    // comment and obj_info lines are skipped
+  }
+  if (!format) ThrowWrongData();
+  return std::size_t(pos - data);
+}
+
+/**
+ * Skips properties [first, last) of one element
+ * @return position after them
+ */
+const char *SkipProperties(const char *pos, const char *end,
+                           const PlyElement &element, std::size_t first,
+                           std::size_t last) {
+  for (std::size_t i = first; i != last; ++i) {
+    const auto &property = element.properties[i];
+    std::size_t items = 1;
+    if (property.count != PlyType::kNone) {
+      if (std::size_t(end - pos) < SizeOf(property.count)) ThrowWrongData();
+      auto count = VisitInteger(property.count, [pos](auto type) {
+        return std::int64_t(ReadLittle<decltype(type)>(pos));
+      });
+      if (count < 0) ThrowWrongData();
+      pos += SizeOf(property.count);
+      items = std::size_t(count);
+    }
+    if (std::size_t(end - pos) / SizeOf(property.type) < items) {
+      ThrowWrongData();
+    }
+    pos += items * SizeOf(property.type);
+  }
+  return pos;
+}
+
+const char *SkipElement(const char *pos, const char *end,
+                        const PlyElement &element) {
+  if (const std::size_t stride = element.Stride()) {
+    if (std::size_t(end - pos) / stride < element.count) ThrowWrongData();
+    return pos + stride * element.count;
+  }
+  if (element.properties.empty()) return pos;
+  for (std::size_t i = 0; i < element.count; ++i) {
+    pos = SkipProperties(pos, end, element, 0, element.properties.size());
+  }
+  return pos;
+}
+
+/**
+ * Reads the x, y and z properties of the vertex element, with one memcpy
+ * per vertex when they are consecutive floats and one in total when there
+ * is nothing else
+ */
+const char *ReadPlyVertexes(const char *pos, const char *end,
+                            const PlyElement &element, vertex &vertexes) {
+  const std::size_t axes[] = {element.Find("x"), element.Find("y"),
+                              element.Find("z")};
+  for (std::size_t axis : axes) {
+    if (axis == element.properties.size()) ThrowWrongData();
+  }
+  // each vertex takes at least a byte per coordinate
+  if (std::size_t(end - pos) / 3 < element.count) ThrowWrongData();
+  if (element.count > kMaxVertexes) {
+    throw std::runtime_error("The mesh has too many vertices.");
+  }
+  vertexes.resize(3 * element.count);
+  float *out = vertexes.data();
+  const auto &properties = element.properties;
+  const std::size_t stride = element.Stride();
+  const bool packed = axes[1] == axes[0] + 1 && axes[2] == axes[0] + 2 &&
+                      properties[axes[0]].type == PlyType::kFloat32 &&
+                      properties[axes[1]].type == PlyType::kFloat32 &&
+                      properties[axes[2]].type == PlyType::kFloat32;
+  if (stride && packed) {
+    if (std::size_t(end - pos) / stride < element.count) ThrowWrongData();
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < axes[0]; ++i) {
+      offset += SizeOf(properties[i].type);
+    }
+    if (stride == 3 * sizeof(float)) {
+      ReadFloats(pos, 3 * element.count, out);
+    } else {
+      for (std::size_t i = 0; i < element.count; ++i) {
+        ReadFloats(pos + i * stride + offset, 3, out + 3 * i);
+      }
+    }
+    return pos + stride * element.count;
+  }
+  for (std::size_t i = 0; i < element.count; ++i) {
+    for (std::size_t j = 0; j != properties.size(); ++j) {
+      // the axes may come in any order among the other properties
+      const auto axis = std::size_t(std::find(axes, axes + 3, j) - axes);
+      if (axis == 3) {
+        pos = SkipProperties(pos, end, element, j, j + 1);
+        continue;
+      }
+      const auto type = properties[j].type;
+      if (std::size_t(end - pos) < SizeOf(type)) ThrowWrongData();
+      out[3 * i + axis] = VisitType(type, [pos](auto value) {
+        return float(ReadLittle<decltype(value)>(pos));
+      });
+      pos += SizeOf(type);
+    }
+  }
+  return pos;
+}
+
+template <class Index>
+unsigned PlyIndex(const char *pos, std::size_t vertex_count) {
+  auto index = ReadLittle<Index>(pos);
+  if constexpr (std::is_signed_v<Index>) {
+    if (index < 0) throw std::runtime_error("Face index out of range.");
+  }
+  if (std::size_t(index) >= vertex_count) {
+    throw std::runtime_error("Face index out of range.");
+  }
+  return unsigned(index) + 1;
+}
+
+/**
+ * Reads the corner list of every face as its closed loop of edges, faces
+ * with less than 3 corners are dropped like in OBJ
+ * @param list - position of the corner list among the face properties
+ */
+template <class Count, class Index>
+const char *ReadPlyFaces(const char *pos, const char *end,
+                         const PlyElement &element, std::size_t list,
+                         std::size_t vertex_count, facet &facetes) {
+  // a face takes at least its count, a bad header can't reserve more
+  const std::size_t faces =
+      std::min(element.count, std::size_t(end - pos) / sizeof(Count));
+  facetes.reserve(facetes.size() + 6 * faces);
+  for (std::size_t i = 0; i < element.count; ++i) {
+    pos = SkipProperties(pos, end, element, 0, list);
+    if (std::size_t(end - pos) < sizeof(Count)) ThrowWrongData();
+    auto count = ReadLittle<Count>(pos);
+    pos += sizeof(Count);
+    if constexpr (std::is_signed_v<Count>) {
+      if (count < 0) ThrowWrongData();
+    }
+    const auto corners = std::size_t(count);
+    if (std::size_t(end - pos) / sizeof(Index) < corners) ThrowWrongData();
+    if (corners >= 3) {
+      const std::size_t at = facetes.size();
+      facetes.resize(at + 2 * corners);
+      unsigned *out = facetes.data() + at;
+      out[0] = out[2 * corners - 1] = PlyIndex<Index>(pos, vertex_count);
+      for (std::size_t j = 1; j < corners; ++j) {
+        out[2 * j - 1] = out[2 * j] =
+            PlyIndex<Index>(pos + j * sizeof(Index), vertex_count);
+      }
+    }
+    pos += corners * sizeof(Index);
+    pos = SkipProperties(pos, end, element, list + 1,
+                         element.properties.size());
+  }
+  return pos;
+}
+
+/**
+ * @class PlyLoader
+ * @brief binary little-endian PLY, the x, y and z of the vertex element and
+ * the vertex_indices (or vertex_index) lists of the face element. Other
+ * properties and elements are skipped
+ */
+class PlyLoader : public MeshLoader {
+ public:
+  [[nodiscard]] const char *Name() const noexcept override { return "PLY"; }
+
+  [[nodiscard]] bool Accepts(const std::string &filename, const char *head,
+                             std::size_t size,
+                             std::size_t) const noexcept override {
+    return HasExtension(filename, ".ply") ||
+           (size >= 4 && std::memcmp(head, "ply\n", 4) == 0) ||
+           (size >= 5 && std::memcmp(head, "ply\r\n", 5) == 0);
+  }
+
+  void Load(const char *data, std::size_t size, Obj &result) const override {
+    std::vector<PlyElement> elements;
+    const char *pos = data + ParsePlyHeader(data, size, elements);
+    const char *end = data + size;
+    std::size_t vertex_count = 0;
+    for (const auto &element : elements) {
+      if (element.name == "vertex") vertex_count = element.count;
+    }
+    for (const auto &element : elements) {
+      if (element.name == "vertex") {
+        pos = ReadPlyVertexes(pos, end, element, *result.vertexes);
+      } else if (element.name == "face") {
+        pos = ReadFaces(pos, end, element, vertex_count, *result.facetes);
+      } else {
+        pos = SkipElement(pos, end, element);
+      }
+    }
+  }
+
+ private:
+  static const char *ReadFaces(const char *pos, const char *end,
+                               const PlyElement &element,
+                               std::size_t vertex_count, facet &facetes) {
+    std::size_t list = 0;
+    const auto &properties = element.properties;
+    while (list != properties.size() &&
+           (properties[list].count == PlyType::kNone ||
+            (properties[list].name != "vertex_indices" &&
+             properties[list].name != "vertex_index"))) {
+      ++list;
+    }
+    if (list == properties.size() || !IsInteger(properties[list].type)) {
+      ThrowWrongData();
+    }
+    return VisitInteger(properties[list].count, [&](auto count) {
+      return VisitInteger(properties[list].type, [&](auto index) {
+        return ReadPlyFaces<decltype(count), decltype(index)>(
+            pos, end, element, list, vertex_count, facetes);
+      });
+    });
+  }
+};
+
+/**
+ * @struct Registry
+ * @brief the loaders in the order they are asked
+ */
+struct Registry {
+  Registry() {
+    loaders.push_back(std::make_unique<StlLoader>());
+    loaders.push_back(std::make_unique<PlyLoader>());
+  }
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<MeshLoader>> loaders;
+};
+
+Registry &Loaders() {
+  static Registry registry;
+  return registry;
+}
+
+}  // namespace
+
+void MeshLoader::Register(std::unique_ptr<MeshLoader> loader) {
+  auto &registry = Loaders();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.loaders.push_back(std::move(loader));
+}
+
+const MeshLoader *MeshLoader::Find(const std::string &filename,
+                                   const char *head, std::size_t size,
+                                   std::size_t file_size) {
+  auto &registry = Loaders();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (const auto &loader : registry.loaders) {
+    if (loader->Accepts(filename, head, size, file_size)) return loader.get();
+  }
+  return nullptr;
+}
+
+const MeshLoader *MeshLoader::Find(const std::string &filename) {
+  struct stat info {};
+  if (stat(filename.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+    // reading the head of a pipe would lose it
+    return Find(filename, nullptr, 0, 0);
+  }
+  char head[kProbeSize];
+  std::ifstream in(filename, std::ios::binary);
+  in.read(head, sizeof(head));
+  return Find(filename, head, std::size_t(in.gcount()),
+              std::size_t(info.st_size));
+}
+
+}  // namespace s21
@@ -5,154 +5,1670 @@
 #include "Model.h"
 
 #include <algorithm>
-#include <iostream>
-#include <sstream>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "MeshCache.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
 
 namespace s21 {
 
+namespace {
+
+bool IsBlank(char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+const char *SkipBlanks(const char *pos, const char *end) noexcept {
+  while (pos != end && IsBlank(*pos)) ++pos;
+  return pos;
+}
+
+const char *SkipToken(const char *pos, const char *end) noexcept {
+  while (pos != end && !IsBlank(*pos)) ++pos;
+  return pos;
+}
+
+/**
+ * Reads a float the way operator>> does: leading blanks and an optional sign
+ * are accepted, parsing stops at the first char that can't continue the number
+ * @return position after the number or nullptr if there is no number
+ */
+const char *ParseFloat(const char *pos, const char *end, float &num) noexcept {
+  pos = SkipBlanks(pos, end);
+  if (pos != end && *pos == '+') ++pos;
+  const char *digits = pos != end && *pos == '-' ? pos + 1 : pos;
+  if (digits == end || !((*digits >= '0' && *digits <= '9') || *digits == '.'))
+    return nullptr;
+  auto [ptr, ec] = std::from_chars(pos, end, num);
+  return ec == std::errc() ? ptr : nullptr;
+}
+
+/**
+ * Reads the vertex index of a face token the way stoi does, so "3/1/2" and
+ * "3//2" both give 3
+ * @return position after the index or nullptr if the token has none
+ */
+const char *ReadIndex(const char *pos, const char *end, int &num) noexcept {
+  const char *digits = pos != end && *pos == '+' ? pos + 1 : pos;
+  auto [ptr, ec] = std::from_chars(digits, end, num);
+  return ec == std::errc() ? ptr : nullptr;
+}
+
+/**
+ * ReadIndex for at most 9 digits, which can't overflow
+ * @return position after the index or nullptr if it is not like that
+ */
+inline const char *ReadShortIndex(const char *pos, const char *end,
+                                  int &num) noexcept {
+  if (pos == end) return nullptr;
+  bool negative = *pos == '-';
+  if (negative || *pos == '+') ++pos;
+  const char *digits = pos;
+  unsigned value = 0;
+  for (; pos != end && unsigned(*pos - '0') < 10; ++pos) {
+    value = value * 10 + unsigned(*pos - '0');
+  }
+  if (pos == digits || pos - digits > 9) return nullptr;
+  num = negative ? -int(value) : int(value);
+  return pos;
+}
+
+/**
+ * Skips a texture or normal index, relative ones included
+ * @return position after it or nullptr if there are no digits
+ */
+const char *SkipAttribute(const char *pos, const char *end) noexcept {
+  if (pos != end && *pos == '-') ++pos;
+  const char *digits = pos;
+  while (pos != end && unsigned(*pos - '0') < 10) ++pos;
+  return pos != digits ? pos : nullptr;
+}
+
+/**
+ * ReadIndex for a token whose end is not known yet
+ * @return position after the whole token or nullptr if it has no index
+ */
+const char *ParseIndex(const char *pos, const char *end, int &num) noexcept {
+  pos = ReadIndex(pos, end, num);
+  return pos ? SkipToken(pos, end) : nullptr;
+}
+
+/**
+ * @return end of the first line that ends at least size chars past begin
+ */
+const char *WindowEnd(const char *begin, const char *end,
+                      std::size_t size) noexcept {
+  if (std::size_t(end - begin) <= size) return end;
+  const char *last = begin + size;
+  while (last != end && last[-1] != '\n') ++last;
+  return last;
+}
+
+/**
+ * @return end of the last whole line in the first StructuralIndex::kMaxBlock
+ * chars, begin if the first line is longer
+ */
+const char *BlockEnd(const char *begin, const char *end) noexcept {
+  if (std::size_t(end - begin) <= StructuralIndex::kMaxBlock) return end;
+  const char *last = begin + StructuralIndex::kMaxBlock;
+  while (last != begin && last[-1] != '\n') --last;
+  return last;
+}
+
+/**
+ * @struct ElementCount
+ * @brief array sizes a range of lines parses into
+ */
+struct ElementCount {
+  std::size_t vertexes = 0;
+  std::size_t facetes = 0;
+};
+
+/**
+ * Counts the v lines and estimates the indices of the f lines from the
+ * corners of the first faces, a line costs one memchr past the sample
+ */
+ElementCount CountElements(const char *pos, const char *end) noexcept {
+  constexpr std::size_t kSampledFaces = 1 << 12;
+  ElementCount count;
+  std::size_t faces = 0, sampled = 0;
+  while (pos != end) {
+    auto *eol = static_cast<const char *>(
+        std::memchr(pos, '\n', std::size_t(end - pos)));
+    if (!eol) eol = end;
+    if (eol - pos > 1 && IsBlank(pos[1])) {
+      if (*pos == 'v') {
+        count.vertexes += 3;
+      } else if (*pos == 'f' && ++faces <= kSampledFaces) {
+        // every corner starts an edge and ends another
+        for (const char *corner = pos + 2; corner != eol; ++corner) {
+          sampled += 2 * (IsBlank(corner[-1]) && !IsBlank(*corner));
+        }
+      }
+    }
+    pos = eol == end ? end : eol + 1;
+  }
+  count.facetes = faces <= kSampledFaces
+                      ? sampled
+                      : std::size_t(double(sampled) * double(faces) /
+                                    double(kSampledFaces));
+  return count;
+}
+
+/**
+ * Subtracts the 1-base from indices in place
+ * @param count - number of vertices, valid indices are below it afterwards
+ * @return position of the first invalid index, size if there is none
+ */
+std::size_t RebaseIndexes(unsigned *data, std::size_t size,
+                          std::size_t count) noexcept {
+  const auto limit = unsigned(
+      std::min<std::size_t>(count, std::numeric_limits<unsigned>::max()));
+  std::size_t i = 0;
+#ifdef __SSE2__
+  // SSE2 compares signed lanes only, flipping the sign bit orders unsigned
+  // values the same way
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i sign = _mm_set1_epi32(std::numeric_limits<int>::min());
+  const __m128i bound = _mm_xor_si128(_mm_set1_epi32(int(limit)), sign);
+  for (; i + 16 <= size; i += 16) {
+    auto *block = reinterpret_cast<__m128i *>(data + i);
+    __m128i valid = _mm_set1_epi32(-1);
+    for (int j = 0; j < 4; ++j) {
+      __m128i num = _mm_sub_epi32(_mm_loadu_si128(block + j), one);
+      _mm_storeu_si128(block + j, num);
+      valid = _mm_and_si128(
+          valid, _mm_cmplt_epi32(_mm_xor_si128(num, sign), bound));
+    }
+    if (_mm_movemask_epi8(valid) != 0xFFFF) {
+      return std::size_t(std::find_if(data + i, data + i + 16,
+                                      [limit](unsigned num) {
+                                        return num >= limit;
+                                      }) -
+                         data);
+    }
+  }
+#endif
+  bool valid = true;
+  std::size_t first = i;
+  for (; i < size; ++i) {
+    data[i] -= 1;
+    valid &= data[i] < limit;
+    first += valid;
+  }
+  return first;
+}
+
+/**
+ * Widens lower and upper to the box of count xyz vertices
+ */
+void ReduceBox(const float *data, std::size_t count, float *lower,
+               float *upper) noexcept {
+  std::size_t i = 0;
+#ifdef __SSE2__
+  if (count >= 4) {
+    // four vertices fill three registers as xyzx yzxy zxyz, so every lane
+    // keeps one axis and no shuffles are needed until the end
+    __m128 low[3], high[3];
+    for (int j = 0; j < 3; ++j) low[j] = high[j] = _mm_loadu_ps(data + 4 * j);
+    for (i = 4; i + 4 <= count; i += 4) {
+      for (int j = 0; j < 3; ++j) {
+        __m128 num = _mm_loadu_ps(data + 3 * i + 4 * j);
+        low[j] = _mm_min_ps(low[j], num);
+        high[j] = _mm_max_ps(high[j], num);
+      }
+    }
+    float lanes_low[12], lanes_high[12];
+    for (int j = 0; j < 3; ++j) {
+      _mm_storeu_ps(lanes_low + 4 * j, low[j]);
+      _mm_storeu_ps(lanes_high + 4 * j, high[j]);
+    }
+    for (int lane = 0; lane < 12; ++lane) {
+      lower[lane % 3] = std::min(lower[lane % 3], lanes_low[lane]);
+      upper[lane % 3] = std::max(upper[lane % 3], lanes_high[lane]);
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      lower[axis] = std::min(lower[axis], data[3 * i + axis]);
+      upper[axis] = std::max(upper[axis], data[3 * i + axis]);
+    }
+  }
+}
+
+/**
+ * @return largest squared distance from center to one of count vertices
+ */
+float ReduceRadius(const float *data, std::size_t count,
+                   const std::array<float, 3> &center) noexcept {
+  float radius = 0;
+  std::size_t i = 0;
+#ifdef __SSE2__
+  const __m128 cx = _mm_set1_ps(center[0]), cy = _mm_set1_ps(center[1]),
+               cz = _mm_set1_ps(center[2]);
+  __m128 farthest = _mm_setzero_ps();
+  for (; i + 4 <= count; i += 4) {
+    const float *pos = data + 3 * i;
+    __m128 dx = _mm_sub_ps(_mm_setr_ps(pos[0], pos[3], pos[6], pos[9]), cx);
+    __m128 dy = _mm_sub_ps(_mm_setr_ps(pos[1], pos[4], pos[7], pos[10]), cy);
+    __m128 dz = _mm_sub_ps(_mm_setr_ps(pos[2], pos[5], pos[8], pos[11]), cz);
+    __m128 distance = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    farthest = _mm_max_ps(farthest, distance);
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, farthest);
+  radius = std::max({lanes[0], lanes[1], lanes[2], lanes[3]});
+#endif
+  for (; i < count; ++i) {
+    float dx = data[3 * i] - center[0], dy = data[3 * i + 1] - center[1],
+          dz = data[3 * i + 2] - center[2];
+    radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+  }
+  return radius;
+}
+
+/**
+ * Sizes consecutive groups by the start of the next one
+ * @param total - end of the last group
+ */
+void SetGroupSizes(std::vector<Group> &groups, std::size_t total) noexcept {
+  for (std::size_t i = 0; i < groups.size(); ++i) {
+    auto end = i + 1 < groups.size() ? groups[i + 1].first : total;
+    groups[i].count = end - groups[i].first;
+  }
+}
+
+std::uint64_t HashEdge(std::uint64_t key) noexcept {
+  key ^= key >> 31;
+  key *= 0x9E3779B97F4A7C15ULL;
+  return key ^ (key >> 29);
+}
+
+/**
+ * @class EdgeSet
+ * @brief open addressing set of edge keys
+ */
+class EdgeSet {
+ public:
+  explicit EdgeSet(std::size_t expected) {
+    std::size_t capacity = 64;
+    while (capacity < expected * 2) capacity *= 2;
+    keys_.assign(capacity, kEmpty);
+    mask_ = capacity - 1;
+  }
+
+  /**
+   * @return true if the key was not in the set yet
+   */
+  bool Insert(std::uint64_t key, std::uint64_t hash) {
+    if (key == kEmpty) return std::exchange(has_empty_, true) == false;
+    if ((size_ + 1) * 2 > keys_.size()) Grow();
+    for (auto i = hash & mask_;; i = (i + 1) & mask_) {
+      if (keys_[i] == key) return false;
+      if (keys_[i] == kEmpty) {
+        keys_[i] = key;
+        ++size_;
+        return true;
+      }
+    }
+  }
+
+ private:
+  void Grow() {
+    std::vector<std::uint64_t> keys(keys_.size() * 2, kEmpty);
+    keys.swap(keys_);
+    mask_ = keys_.size() - 1;
+    for (auto key : keys) {
+      if (key == kEmpty) continue;
+      auto i = HashEdge(key) & mask_;
+      while (keys_[i] != kEmpty) i = (i + 1) & mask_;
+      keys_[i] = key;
+    }
+  }
+
+  static constexpr std::uint64_t kEmpty = ~std::uint64_t(0);
+  std::vector<std::uint64_t> keys_;
+  std::size_t mask_ = 0;
+  std::size_t size_ = 0;
+  bool has_empty_ = false;
+};
+
+/**
+ * @class VertexSet
+ * @brief open addressing map from position keys to the first vertex index
+ * inserted with the key
+ */
+class VertexSet {
+ public:
+  using Key = std::array<std::uint32_t, 3>;
+
+  /// Find result for a key that wasn't inserted
+  static constexpr unsigned kNone = ~0u;
+
+  explicit VertexSet(std::size_t expected) {
+    std::size_t capacity = 64;
+    while (capacity < expected * 2) capacity *= 2;
+    slots_.resize(capacity);
+    mask_ = capacity - 1;
+  }
+
+  /**
+   * @return the first index inserted with the key
+   */
+  unsigned Insert(const Key &key, std::uint64_t hash, unsigned index) {
+    if ((size_ + 1) * 2 > slots_.size()) Grow();
+    for (auto i = hash & mask_;; i = (i + 1) & mask_) {
+      auto &slot = slots_[i];
+      if (slot.index == kEmpty) {
+        slot = {key, index};
+        ++size_;
+        return index;
+      }
+      if (slot.key == key) return slot.index;
+    }
+  }
+
+  /**
+   * @return the first index inserted with the key, kNone if there is none
+   */
+  unsigned Find(const Key &key, std::uint64_t hash) const noexcept {
+    for (auto i = hash & mask_;; i = (i + 1) & mask_) {
+      const auto &slot = slots_[i];
+      if (slot.index == kEmpty || slot.key == key) return slot.index;
+    }
+  }
+
+  static std::uint64_t Hash(const Key &key) noexcept {
+    return HashEdge((std::uint64_t(key[0]) << 32 | key[1]) ^
+                    HashEdge(key[2]));
+  }
+
+  /**
+   * Exact positions map to their bits, -0 and 0 being equal, otherwise to
+   * the cell of a grid with epsilon step. Positions within epsilon of each
+   * other are in the same or adjacent cells
+   */
+  static Key KeyOf(const float *position, float epsilon) noexcept {
+    Key key;
+    for (int i = 0; i < 3; ++i) {
+      if (epsilon > 0) {
+        float cell =
+            std::clamp(std::floor(position[i] / epsilon), -2e9f, 2e9f);
+        key[i] = std::uint32_t(std::int32_t(cell));
+      } else {
+        float num = position[i] + 0.0f;
+        std::memcpy(&key[i], &num, sizeof(num));
+      }
+    }
+    return key;
+  }
+
+ private:
+  static constexpr unsigned kEmpty = kNone;
+
+  /**
+   * @struct Slot
+   * @brief key and its first vertex, kEmpty index marks a free slot
+   */
+  struct Slot {
+    Key key;
+    unsigned index = kEmpty;
+  };
+
+  void Grow() {
+    std::vector<Slot> slots(slots_.size() * 2);
+    slots.swap(slots_);
+    mask_ = slots_.size() - 1;
+    for (auto &slot : slots) {
+      if (slot.index == kEmpty) continue;
+      auto i = Hash(slot.key) & mask_;
+      while (slots_[i].index != kEmpty) i = (i + 1) & mask_;
+      slots_[i] = slot;
+    }
+  }
+
+  std::vector<Slot> slots_;
+  std::size_t mask_ = 0;
+  std::size_t size_ = 0;
+};
+
+/**
+ * Sets first[i] to the first kept vertex within epsilon of vertex i, which
+ * is kept itself when there is none. Such a vertex is in one of the 27 grid
+ * cells around i, every cell lists its kept vertexes in order
+ */
+void MatchWithin(const float *data, std::size_t count, float epsilon,
+                 unsigned *first) {
+  VertexSet cells(count);
+  std::vector<unsigned> next(count, VertexSet::kNone);
+  const float limit = epsilon * epsilon;
+  for (std::size_t i = 0; i < count; ++i) {
+    const float *position = data + 3 * i;
+    const auto key = VertexSet::KeyOf(position, epsilon);
+    auto match = unsigned(i);
+    for (std::uint32_t dx = -1; dx != 2; ++dx) {
+      for (std::uint32_t dy = -1; dy != 2; ++dy) {
+        for (std::uint32_t dz = -1; dz != 2; ++dz) {
+          const VertexSet::Key cell{key[0] + dx, key[1] + dy, key[2] + dz};
+          for (auto j = cells.Find(cell, VertexSet::Hash(cell)); j < match;
+               j = next[j]) {
+            float distance = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+              float delta = position[axis] - data[3 * std::size_t(j) + axis];
+              distance += delta * delta;
+            }
+            if (distance <= limit) match = j;
+          }
+        }
+      }
+    }
+    first[i] = match;
+    if (match != i) continue;
+    auto last = cells.Insert(key, VertexSet::Hash(key), match);
+    if (last == match) continue;
+    while (next[last] != VertexSet::kNone) last = next[last];
+    next[last] = match;
+  }
+}
+
+/**
+ * @class BlockQueue
+ * @brief bounded queue of read or decompressed blocks between the reader
+ * thread and the parser, parsed blocks go back to the producer for reuse
+ */
+class BlockQueue {
+ public:
+  /**
+   * @struct Block
+   * @brief fixed-size buffer and the part of it that is filled
+   */
+  struct Block {
+    std::unique_ptr<char[]> data;
+    std::size_t size = 0;
+    /// file bytes consumed once the block was filled
+    std::size_t consumed = 0;
+  };
+
+  BlockQueue(std::size_t count, std::size_t capacity)
+      : blocks_(count), capacity_(capacity) {
+    for (auto &block : blocks_) {
+      block.data = std::make_unique<char[]>(capacity);
+      free_.push_back(&block);
+    }
+  }
+
+  [[nodiscard]] std::size_t Capacity() const noexcept { return capacity_; }
+
+  /**
+   * Waits for an empty block
+   * @return nullptr once the consumer has closed the queue
+   */
+  Block *Acquire() {
+    std::unique_lock lock(mutex_);
+    cond_.wait(lock, [this] { return closed_ || !free_.empty(); });
+    if (closed_) return nullptr;
+    auto *block = free_.front();
+    free_.pop_front();
+    return block;
+  }
+
+  void Push(Block *block) {
+    {
+      std::lock_guard lock(mutex_);
+      full_.push_back(block);
+    }
+    cond_.notify_all();
+  }
+
+  /**
+   * Marks the end of the data
+   * @param error - exception to rethrow in the consumer, if any
+   */
+  void Finish(std::exception_ptr error = nullptr) {
+    {
+      std::lock_guard lock(mutex_);
+      finished_ = true;
+      error_ = std::move(error);
+    }
+    cond_.notify_all();
+  }
+
+  /**
+   * Waits for a filled block
+   * @return nullptr at the end of the data
+   * @throw the producer's exception
+   */
+  Block *Pop() {
+    std::unique_lock lock(mutex_);
+    cond_.wait(lock, [this] { return finished_ || !full_.empty(); });
+    if (!full_.empty()) {
+      auto *block = full_.front();
+      full_.pop_front();
+      return block;
+    }
+    if (error_) std::rethrow_exception(error_);
+    return nullptr;
+  }
+
+  void Release(Block *block) {
+    {
+      std::lock_guard lock(mutex_);
+      free_.push_back(block);
+    }
+    cond_.notify_all();
+  }
+
+  /**
+   * Stops the producer, called when the consumer gives up
+   */
+  void Close() {
+    {
+      std::lock_guard lock(mutex_);
+      closed_ = true;
+    }
+    cond_.notify_all();
+  }
+
+ private:
+  std::vector<Block> blocks_;
+  std::size_t capacity_;
+  std::deque<Block *> free_, full_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool finished_ = false, closed_ = false;
+  std::exception_ptr error_;
+};
+
+/**
+ * @class StageTimer
+ * @brief adds the time from its construction to its destruction to a stage
+ * of LoadTimings
+ */
+class StageTimer {
+ public:
+  explicit StageTimer(double &seconds) noexcept
+      : seconds_(seconds), start_(Clock::now()) {}
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+  ~StageTimer() {
+    seconds_ += std::chrono::duration<double>(Clock::now() - start_).count();
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  double &seconds_;
+  Clock::time_point start_;
+};
+
+}  // namespace
+
 void OpenFileCommand::Open() {
-  in_file_.open(filename_);
+  loader_ = MeshLoader::Find(filename_);
+  if (loader_) {
+    // binary meshes are used in place whatever their size
+    if (!mapped_.Map(filename_, 1, options_.huge_pages)) {
+      throw std::runtime_error("Failed to open the file.");
+    }
+    return;
+  }
+  if (options_.use_mmap &&
+      mapped_.Map(filename_, options_.mmap_threshold, options_.huge_pages)) {
+    format_ = Decompressor::Detect(mapped_.begin(), mapped_.size());
+    if (format_ == Decompressor::Format::kPlain) return;
+    mapped_.Unmap();
+  }
+  in_file_.open(filename_, std::ios::binary);
   if (!in_file_.is_open()) {
     throw std::runtime_error("Failed to open the file.");
   }
+  if (format_ != Decompressor::Format::kPlain) return;
+  if (in_file_.tellg() == std::streampos(-1)) {
+    // pipes can't be rewound after sniffing the magic bytes
+    in_file_.clear();
+    format_ = Decompressor::Detect(filename_);
+    return;
+  }
+  char magic[4] = {};
+  in_file_.read(magic, sizeof(magic));
+  format_ = Decompressor::Detect(magic, std::size_t(in_file_.gcount()));
+  in_file_.clear();
+  in_file_.seekg(0, std::ios::beg);
 }
 
 void OpenFileCommand::ReadObj() {
-  std::string line;
-  result_.vertexes = new vertex;
-  result_.facetes = new facet;
+  result_.vertexes = std::make_unique<vertex>();
+  result_.facetes = std::make_unique<facet>();
+  threads_ = options_.threads
+                 ? options_.threads
+                 : std::max(1u, std::thread::hardware_concurrency());
+  if (loader_) {
+    ReadBinary();
+  } else if (format_ != Decompressor::Format::kPlain) {
+    ReadCompressed();
+  } else if (mapped_.IsMapped()) {
+    ReadMapped();
+  } else {
+    ReadBuffered();
+  }
+  auto &timings = result_.timings;
+  {
+    StageTimer timer(timings.resolve);
+    FinishGroups();
+    ResolveIndexes();
+  }
+  {
+    StageTimer timer(timings.dedup);
+    if (options_.weld || (loader_ && loader_->Welds())) WeldVertexes();
+    if (options_.unique_edges) DeduplicateEdges();
+  }
+  StageTimer timer(timings.bounds);
+  ComputeBounds();
+}
 
-  while (std::getline(in_file_, line)) {
-    auto begin = line.substr(0, 2);
-    if (begin == "v ") {
-      std::istringstream stream(line.substr(2));
-      float x, y, z;
+void OpenFileCommand::ReadMapped() {
+  const std::size_t window = std::max(kWindowSize, threads_ * kBlockSize);
+  const char *begin = mapped_.begin(), *end = mapped_.end();
+  // sized once up front, growing by doubling would copy the arrays several
+  // times and leave up to half of them unused
+  ElementCount count;
+  {
+    // the first pass faults the pages in, the kernel reads ahead of it
+    StageTimer timer(result_.timings.read);
+    for (const char *pos = begin; pos != end;) {
+      const char *last = WindowEnd(pos, end, window);
+      auto part = CountElements(pos, last);
+      count.vertexes += part.vertexes;
+      count.facetes += part.facetes;
+      mapped_.Evict(last);
+      pos = last;
+    }
+  }
+  result_.vertexes->reserve(count.vertexes);
+  result_.facetes->reserve(count.facetes + count.facetes / 16);
+  while (begin != end) {
+    const char *last = WindowEnd(begin, end, window);
+    {
+      StageTimer timer(result_.timings.parse);
+      ParseRange(begin, last);
+    }
+    mapped_.Release(last);
+    begin = last;
+    ReportProgress(std::size_t(last - mapped_.begin()), mapped_.size());
+  }
+  mapped_.Unmap();
+}
+
+void OpenFileCommand::ReadBinary() {
+  const std::size_t size = mapped_.size();
+  ReportProgress(0, size);
+  {
+    StageTimer timer(result_.timings.parse);
+    loader_->Load(mapped_.begin(), size, result_);
+  }
+  mapped_.Unmap();
+  ReportProgress(size, size);
+}
+
+void OpenFileCommand::ReadBuffered() {
+  BlockReader reader;
+  if (options_.async_reads &&
+      reader.Open(filename_, BlockReader::Best(), options_.direct_io)) {
+    in_file_.close();
+    ReadBlocks(
+        [&reader](char *data, std::size_t capacity, std::size_t &consumed) {
+          auto size = reader.Read(data, capacity);
+          consumed = reader.Consumed();
+          return size;
+        },
+        reader.size());
+    return;
+  }
+  std::size_t done = 0;
+  ReadBlocks(
+      [this, &done](char *data, std::size_t capacity, std::size_t &consumed) {
+        in_file_.read(data, std::streamsize(capacity));
+        auto size = std::size_t(in_file_.gcount());
+        consumed = done += size;
+        return size;
+      },
+      StreamSize());
+  in_file_.close();
+}
 
-      if (stream >> x >> y >> z) {
-        result_.vertexes->push_back(FindMaxMin(x));
-        result_.vertexes->push_back(FindMaxMin(y));
-        result_.vertexes->push_back(FindMaxMin(z));
+void OpenFileCommand::ReadCompressed() {
+  auto decompressor = Decompressor::Create(format_, in_file_);
+  ReadBlocks(
+      [&decompressor](char *data, std::size_t capacity,
+                      std::size_t &consumed) {
+        auto size = decompressor->Read(data, capacity);
+        consumed = decompressor->Consumed();
+        return size;
+      },
+      StreamSize());
+  in_file_.close();
+}
+
+std::size_t OpenFileCommand::StreamSize() {
+  std::size_t total = 0;
+  if (in_file_.seekg(0, std::ios::end)) {
+    total = std::size_t(in_file_.tellg());
+    in_file_.seekg(0, std::ios::beg);
+  } else {
+    in_file_.clear();
+  }
+  return total;
+}
+
+template <class Read>
+void OpenFileCommand::ReadBlocks(Read read, std::size_t total) {
+  auto &timings = result_.timings;
+  BlockQueue queue(kQueueBlocks, threads_ * kBlockSize);
+  // the producer only touches timings.read, read back after the join
+  std::thread producer([&queue, &read, &timings] {
+    try {
+      while (auto *block = queue.Acquire()) {
+        {
+          StageTimer timer(timings.read);
+          block->size =
+              read(block->data.get(), queue.Capacity(), block->consumed);
+        }
+        if (!block->size) break;
+        queue.Push(block);
       }
+      queue.Finish();
+    } catch (...) {
+      queue.Finish(std::current_exception());
     }
-  }
-  in_file_.clear();
-  in_file_.seekg(0, std::ios::beg);
-  while (std::getline(in_file_, line)) {
-    auto begin = line.substr(0, 2);
-    if (begin == "f ") {
-      std::istringstream stream(line.substr(2));
-      std::string f1, f2, f3;
-
-      if (stream >> f1 >> f2 >> f3) {
-        unsigned num1, num2, num3;
-        try {
-          num1 = CorrectIndex(stoi(f1)), num2 = CorrectIndex(stoi(f2)),
-          num3 = CorrectIndex(stoi(f3));
-          result_.facetes->push_back(num1 - 1);
-          result_.facetes->push_back(num2 - 1);
-          result_.facetes->push_back(num2 - 1);
-          result_.facetes->push_back(num3 - 1);
-          result_.facetes->push_back(num3 - 1);
-          while (stream >> f2) {
-            num2 = stoi(f2);
-            result_.facetes->push_back(num2 - 1);
-            result_.facetes->push_back(num2 - 1);
+  });
+
+  try {
+    // the line that crosses a block boundary, parsed on its own
+    std::vector<char> carry;
+    auto pop = [&queue, &timings] {
+      StageTimer timer(timings.stall);
+      return queue.Pop();
+    };
+    while (auto *block = pop()) {
+      {
+        StageTimer timer(timings.parse);
+        const char *begin = block->data.get(), *end = begin + block->size;
+        if (!carry.empty()) {
+          auto *line_end =
+              static_cast<const char *>(std::memchr(begin, '\n', block->size));
+          const char *next = line_end ? line_end + 1 : end;
+          carry.insert(carry.end(), begin, next);
+          if (line_end) {
+            ParseRange(carry.data(), carry.data() + carry.size());
+            carry.clear();
           }
-          result_.facetes->push_back(num1 - 1);
-        } catch (std::invalid_argument &) {
+          begin = next;
         }
+        const char *last = end;
+        while (last != begin && last[-1] != '\n') --last;
+        ParseRange(begin, last);
+        carry.insert(carry.end(), last, end);
       }
+      std::size_t consumed = block->consumed;
+      queue.Release(block);
+      ReportProgress(consumed, total);
     }
+    StageTimer timer(timings.parse);
+    if (!carry.empty()) ParseRange(carry.data(), carry.data() + carry.size());
+  } catch (...) {
+    queue.Close();
+    producer.join();
+    throw;
   }
-  in_file_.close();
+  producer.join();
+}
+
+void OpenFileCommand::ReportProgress(std::size_t done, std::size_t total) {
+  if (options_.cancel && *options_.cancel) {
+    throw std::runtime_error("Loading cancelled.");
+  }
+  if (options_.progress) options_.progress(done, total);
+}
+
+void OpenFileCommand::ParseRange(const char *begin, const char *end) {
+  const auto size = std::size_t(end - begin);
+  const std::size_t count = std::clamp<std::size_t>(
+      size / std::max<std::size_t>(options_.chunk_size, 1), 1, threads_);
+  if (count == 1) {
+    // a single chunk is parsed straight into the result, nothing to merge
+    Chunk chunk{std::move(*result_.vertexes), std::move(*result_.facetes), {},
+                std::move(result_.groups), true};
+    ParseLines(begin, end, chunk);
+    result_.generic_faces += chunk.generic_faces;
+    *result_.vertexes = std::move(chunk.vertexes);
+    *result_.facetes = std::move(chunk.facetes);
+    result_.groups = std::move(chunk.groups);
+    return;
+  }
+  if (chunks_.size() < count) chunks_.resize(count);
+
+  std::vector<const char *> bounds{begin};
+  for (std::size_t i = 1; i < count; ++i) {
+    const char *bound = std::max(begin + size * i / count, bounds.back());
+    while (bound != end && bound[-1] != '\n') ++bound;
+    bounds.push_back(bound);
+  }
+  bounds.push_back(end);
+
+  RunParallel(count, [&](std::size_t i) {
+    auto &chunk = chunks_[i];
+    chunk.vertexes.clear();
+    chunk.facetes.clear();
+    chunk.relative.clear();
+    chunk.groups.clear();
+    chunk.generic_faces = 0;
+    ParseLines(bounds[i], bounds[i + 1], chunk);
+  });
+  MergeChunks(count);
+}
+
+void OpenFileCommand::MergeChunks(std::size_t count) {
+  auto &vertexes = *result_.vertexes;
+  auto &facetes = *result_.facetes;
+  std::vector<std::size_t> vertex_offsets{vertexes.size()};
+  std::vector<std::size_t> facet_offsets{facetes.size()};
+  for (std::size_t i = 0; i < count; ++i) {
+    auto &chunk = chunks_[i];
+    vertex_offsets.push_back(vertex_offsets.back() + chunk.vertexes.size());
+    facet_offsets.push_back(facet_offsets.back() + chunk.facetes.size());
+    result_.generic_faces += chunk.generic_faces;
+    for (auto &group : chunk.groups) {
+      group.first += facet_offsets[i];
+      result_.groups.push_back(std::move(group));
+    }
+  }
+  vertexes.resize(vertex_offsets.back());
+  facetes.resize(facet_offsets.back());
+
+  RunParallel(count, [&](std::size_t i) {
+    auto &chunk = chunks_[i];
+    std::copy(chunk.vertexes.begin(), chunk.vertexes.end(),
+              vertexes.begin() + std::ptrdiff_t(vertex_offsets[i]));
+    std::copy(chunk.facetes.begin(), chunk.facetes.end(),
+              facetes.begin() + std::ptrdiff_t(facet_offsets[i]));
+    auto first = unsigned(vertex_offsets[i] / 3);
+    for (auto pos : chunk.relative) {
+      facetes[facet_offsets[i] + pos] += first;
+    }
+  });
+}
+
+void OpenFileCommand::FinishGroups() {
+  auto &groups = result_.groups;
+  if (groups.empty()) return;
+  if (groups.front().first) {
+    Group group;
+    group.name = "default";
+    groups.insert(groups.begin(), std::move(group));
+  }
+  SetGroupSizes(groups, result_.facetes->size());
+  groups.erase(std::remove_if(groups.begin(), groups.end(),
+                              [](const Group &group) { return !group.count; }),
+               groups.end());
+}
+
+void OpenFileCommand::ResolveIndexes() {
+  auto &facetes = *result_.facetes;
+  const std::size_t count = result_.vertexes->size() / 3;
+  const std::size_t parts =
+      facetes.size() < kParallelIndexes ? 1 : threads_;
+  const std::size_t part_size = (facetes.size() + parts - 1) / parts;
+  std::vector<std::size_t> bad(parts, facetes.size());
+  RunParallel(parts, [&](std::size_t part) {
+    std::size_t begin = std::min(part * part_size, facetes.size());
+    std::size_t size = std::min(part_size, facetes.size() - begin);
+    std::size_t pos = RebaseIndexes(facetes.data() + begin, size, count);
+    if (pos != size) bad[part] = begin + pos;
+  });
+  std::size_t first = *std::min_element(bad.begin(), bad.end());
+  if (first == facetes.size()) return;
+  // binary formats have no lines, rereading them as OBJ text finds nothing
+  std::size_t line = loader_ ? 0 : LineOfIndex(first);
+  throw std::runtime_error(
+      line ? "Face index out of range at line " + std::to_string(line) + "."
+           : std::string("Face index out of range."));
+}
+
+std::size_t OpenFileCommand::LineOfIndex(std::size_t position) const {
+  std::ifstream in(filename_, std::ios::binary);
+  if (!in.is_open()) return 0;
+  std::unique_ptr<Decompressor> decompressor;
+  if (format_ != Decompressor::Format::kPlain) {
+    decompressor = Decompressor::Create(format_, in);
+  }
+  Chunk scratch;
+  scratch.direct = true;
+  std::size_t line = 1, seen = 0;
+  // face lines only add indices, find the one that reaches position
+  auto reaches = [&](const std::string &text) {
+    if (text.size() > 1 && text[0] == 'f' && text[1] == ' ') {
+      scratch.facetes.clear();
+      ParseFacet(text.data() + 2, text.data() + text.size(), scratch);
+      seen += scratch.facetes.size();
+    }
+    return seen > position;
+  };
+  std::vector<char> buffer(kBlockSize);
+  std::string text;
+  while (true) {
+    std::size_t size;
+    if (decompressor) {
+      size = decompressor->Read(buffer.data(), buffer.size());
+    } else {
+      in.read(buffer.data(), std::streamsize(buffer.size()));
+      size = std::size_t(in.gcount());
+    }
+    if (!size) break;
+    const char *pos = buffer.data(), *end = pos + size;
+    while (auto *eol = static_cast<const char *>(
+               std::memchr(pos, '\n', std::size_t(end - pos)))) {
+      text.append(pos, eol);
+      if (reaches(text)) return line;
+      text.clear();
+      ++line;
+      pos = eol + 1;
+    }
+    text.append(pos, end);
+  }
+  return reaches(text) ? line : 0;
+}
+
+template <class Task>
+void OpenFileCommand::RunParallel(std::size_t count, const Task &task) {
+  std::vector<std::exception_ptr> errors(count);
+  auto guarded = [&](std::size_t i) {
+    try {
+      task(i);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < count; ++i) workers.emplace_back(guarded, i);
+  guarded(0);
+  for (auto &worker : workers) worker.join();
+  for (auto &error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
+}
+
+template <class HashOf>
+std::vector<std::vector<OpenFileCommand::Hashed>>
+OpenFileCommand::ScatterByHash(std::size_t count, std::size_t parts,
+                               const HashOf &hash_of) {
+  std::vector<std::vector<Hashed>> buckets(parts * parts);
+  RunParallel(parts, [&](std::size_t range) {
+    const auto begin = count * range / parts, end = count * (range + 1) / parts;
+    auto *own = buckets.data() + range * parts;
+    for (std::size_t part = 0; part < parts; ++part) {
+      own[part].reserve((end - begin) / parts + (end - begin) / parts / 8);
+    }
+    for (auto i = begin; i < end; ++i) {
+      auto hash = hash_of(i);
+      own[(hash >> 32) % parts].push_back({hash, unsigned(i)});
+    }
+  });
+  return buckets;
+}
+
+void OpenFileCommand::WeldVertexes() {
+  auto &vertexes = *result_.vertexes;
+  auto &facetes = *result_.facetes;
+  const std::size_t count = vertexes.size() / 3;
+  const std::size_t parts = count < kParallelVertexes ? 1 : threads_;
+  const float epsilon = options_.weld_epsilon;
+
+  std::vector<unsigned> first(count);
+  auto key_of = [&](std::size_t i) {
+    return VertexSet::KeyOf(&vertexes[3 * i], epsilon);
+  };
+  if (epsilon > 0) {
+    // neighbouring cells may hash to different parts, so this is serial
+    MatchWithin(vertexes.data(), count, epsilon, first.data());
+  } else if (parts == 1) {
+    VertexSet seen(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      auto key = key_of(i);
+      first[i] = seen.Insert(key, VertexSet::Hash(key), unsigned(i));
+    }
+  } else {
+    // every part finds the first vertex for the keys hashed to it
+    auto buckets = ScatterByHash(count, parts, [&](std::size_t i) {
+      return VertexSet::Hash(key_of(i));
+    });
+    RunParallel(parts, [&](std::size_t part) {
+      VertexSet seen(count / parts);
+      for (std::size_t range = 0; range < parts; ++range) {
+        auto &bucket = buckets[range * parts + part];
+        for (auto [hash, i] : bucket) {
+          first[i] = seen.Insert(key_of(i), hash, i);
+        }
+        std::vector<Hashed>().swap(bucket);
+      }
+    });
+  }
+
+  // first occurrences are kept in order, the others take their new index
+  unsigned unique = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (first[i] == i) {
+      std::copy_n(&vertexes[3 * i], 3, &vertexes[3 * std::size_t(unique)]);
+      first[i] = unique++;
+    } else {
+      first[i] = first[first[i]];
+    }
+  }
+  vertexes.resize(3 * std::size_t(unique));
+  vertexes.shrink_to_fit();
+  result_.welded = count - unique;
+
+  RunParallel(parts, [&](std::size_t part) {
+    for (auto i = facetes.size() * part / parts,
+              end = facetes.size() * (part + 1) / parts;
+         i < end; ++i) {
+      if (facetes[i] < count) facetes[i] = first[facetes[i]];
+    }
+  });
 }
 
-float &OpenFileCommand::FindMaxMin(float &num) &noexcept {
-  if (std::isnan(result_.min)) {
-    result_.min = num;
-    result_.max = num;
-  } else if (num > result_.max) {
-    result_.max = num;
-  } else if (num < result_.min) {
-    result_.min = num;
+void OpenFileCommand::ComputeBounds() {
+  const auto &vertexes = *result_.vertexes;
+  const std::size_t count = vertexes.size() / 3;
+  const std::size_t parts = count < kParallelVertexes ? 1 : threads_;
+  auto part_begin = [&](std::size_t part) { return count * part / parts; };
+  Bounds bounds;
+  if (count) {
+    std::copy_n(vertexes.data(), 3, bounds.lower.begin());
+    std::copy_n(vertexes.data(), 3, bounds.upper.begin());
+  }
+  std::vector<Bounds> part_bounds(parts, bounds);
+  RunParallel(parts, [&](std::size_t part) {
+    auto begin = part_begin(part);
+    ReduceBox(vertexes.data() + 3 * begin, part_begin(part + 1) - begin,
+              part_bounds[part].lower.data(), part_bounds[part].upper.data());
+  });
+  for (const auto &part : part_bounds) {
+    for (int axis = 0; axis < 3; ++axis) {
+      bounds.lower[axis] = std::min(bounds.lower[axis], part.lower[axis]);
+      bounds.upper[axis] = std::max(bounds.upper[axis], part.upper[axis]);
+    }
+  }
+  if (options_.bounding_sphere && count) {
+    std::vector<float> radiuses(parts);
+    const auto center = bounds.Center();
+    RunParallel(parts, [&](std::size_t part) {
+      auto begin = part_begin(part);
+      radiuses[part] = ReduceRadius(vertexes.data() + 3 * begin,
+                                    part_begin(part + 1) - begin, center);
+    });
+    bounds.radius =
+        std::sqrt(*std::max_element(radiuses.begin(), radiuses.end()));
   }
-  return num;
+  result_.bounds = bounds;
+  result_.min = *std::min_element(bounds.lower.begin(), bounds.lower.end());
+  result_.max = *std::max_element(bounds.upper.begin(), bounds.upper.end());
+
+  auto &groups = result_.groups;
+  if (groups.empty()) return;
+  const auto &facetes = *result_.facetes;
+  const std::size_t group_parts = std::min(groups.size(), threads_);
+  RunParallel(group_parts, [&](std::size_t part) {
+    for (auto i = groups.size() * part / group_parts,
+              end = groups.size() * (part + 1) / group_parts;
+         i < end; ++i) {
+      auto &group = groups[i];
+      if (!group.count) continue;
+      auto position = [&](std::size_t j) {
+        return vertexes.data() + 3 * std::size_t(facetes[j]);
+      };
+      Bounds box;
+      std::copy_n(position(group.first), 3, box.lower.begin());
+      box.upper = box.lower;
+      unsigned low = facetes[group.first], high = low;
+      for (auto j = group.first; j < group.first + group.count; ++j) {
+        low = std::min(low, facetes[j]);
+        high = std::max(high, facetes[j]);
+        ReduceBox(position(j), 1, box.lower.data(), box.upper.data());
+      }
+      if (options_.bounding_sphere) {
+        const auto center = box.Center();
+        float radius = 0;
+        for (auto j = group.first; j < group.first + group.count; ++j) {
+          radius = std::max(radius, ReduceRadius(position(j), 1, center));
+        }
+        box.radius = std::sqrt(radius);
+      }
+      group.bounds = box;
+      group.first_vertex = low;
+      group.vertex_count = high - low + 1;
+    }
+  });
 }
-unsigned int OpenFileCommand::CorrectIndex(const int &num) const noexcept {
-  static const unsigned size = result_.vertexes->size() / 3;
-  return num < 0 ? num + size : num;
+
+std::uint64_t OpenFileCommand::CacheVariant() const noexcept {
+  std::uint32_t epsilon = 0;
+  if (options_.weld) {
+    std::memcpy(&epsilon, &options_.weld_epsilon, sizeof(epsilon));
+  }
+  return std::uint64_t(options_.unique_edges) |
+         std::uint64_t(options_.weld) << 1 |
+         std::uint64_t(options_.bounding_sphere) << 2 |
+         std::uint64_t(epsilon) << 32;
+}
+
+void OpenFileCommand::DeduplicateEdges() {
+  auto &facetes = *result_.facetes;
+  const std::size_t edges = facetes.size() / 2;
+  const std::size_t parts = edges < kParallelEdges ? 1 : threads_;
+  auto key_of = [&facetes](std::size_t edge) {
+    auto a = facetes[2 * edge], b = facetes[2 * edge + 1];
+    return a < b ? std::uint64_t(a) << 32 | b : std::uint64_t(b) << 32 | a;
+  };
+
+  // every part keeps the first occurrence of the edges hashed to it, so the
+  // result doesn't depend on the number of parts
+  std::vector<std::uint8_t> keep(edges);
+  if (parts == 1) {
+    EdgeSet seen(edges);
+    for (std::size_t i = 0; i < edges; ++i) {
+      auto key = key_of(i);
+      keep[i] = seen.Insert(key, HashEdge(key));
+    }
+  } else {
+    auto buckets = ScatterByHash(
+        edges, parts, [&](std::size_t i) { return HashEdge(key_of(i)); });
+    RunParallel(parts, [&](std::size_t part) {
+      EdgeSet seen(edges / parts);
+      for (std::size_t range = 0; range < parts; ++range) {
+        auto &bucket = buckets[range * parts + part];
+        for (auto [hash, i] : bucket) keep[i] = seen.Insert(key_of(i), hash);
+        std::vector<Hashed>().swap(bucket);
+      }
+    });
+  }
+
+  // groups start where their first kept edge lands
+  auto group = result_.groups.begin();
+  std::size_t unique = 0;
+  for (std::size_t i = 0; i < edges; ++i) {
+    for (; group != result_.groups.end() && group->first <= 2 * i; ++group) {
+      group->first = 2 * unique;
+    }
+    if (!keep[i]) continue;
+    auto key = key_of(i);
+    facetes[2 * unique] = unsigned(key >> 32);
+    facetes[2 * unique + 1] = unsigned(key);
+    ++unique;
+  }
+  for (; group != result_.groups.end(); ++group) group->first = 2 * unique;
+  facetes.resize(2 * unique);
+  facetes.shrink_to_fit();
+  SetGroupSizes(result_.groups, facetes.size());
+}
+
+void OpenFileCommand::ParseLines(const char *begin, const char *end,
+                                 Chunk &chunk) {
+  // a scalar index costs more than it saves
+  const bool indexed =
+      StructuralIndex::Best() != StructuralIndex::Isa::kScalar;
+  StructuralIndex index;
+  while (begin != end) {
+    const char *last = indexed ? BlockEnd(begin, end) : begin;
+    if (last == begin) {
+      auto *eol =
+          static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+      if (!eol) eol = end;
+      ParseLine(begin, eol, chunk);
+      begin = eol == end ? end : eol + 1;
+      continue;
+    }
+    index.Build(begin, std::size_t(last - begin));
+    ParseIndexed(begin, last, index, chunk);
+    begin = last;
+  }
+}
+
+void OpenFileCommand::ParseIndexed(const char *begin, const char *end,
+                                   const StructuralIndex &index,
+                                   Chunk &chunk) {
+  const std::uint16_t *pos = index.begin(), *stop = index.end();
+  const char *line = begin;
+  while (line != end) {
+    // a line starts a token unless it is blank, then it has a break
+    const std::uint16_t *tokens = pos;
+    while (pos != stop && begin[*pos] != '\n') ++pos;
+    const char *eol = pos != stop ? begin + *pos : end;
+    if (eol - line > 1 && line[1] == ' ') {
+      // the keyword is the first token
+      auto count = std::size_t(pos - tokens);
+      if (*line == 'v') {
+        ParseVertex(line, eol, begin, tokens + 1, count - 1, chunk);
+      } else if (*line == 'f') {
+        ParseFacet(eol, begin, tokens + 1, count - 1, chunk);
+      } else if (*line == 'g' || *line == 'o') {
+        ParseGroup(line + 2, eol, chunk);
+      }
+    }
+    if (pos != stop) ++pos;
+    line = eol == end ? end : eol + 1;
+  }
+}
+
+void OpenFileCommand::ParseLine(const char *begin, const char *eol,
+                                Chunk &chunk) {
+  if (eol - begin > 1 && begin[1] == ' ') {
+    if (*begin == 'v') {
+      ParseVertex(begin + 2, eol, chunk);
+    } else if (*begin == 'f') {
+      ParseFacet(begin + 2, eol, chunk);
+    } else if (*begin == 'g' || *begin == 'o') {
+      ParseGroup(begin + 2, eol, chunk);
+    }
+  }
+}
+
+void OpenFileCommand::ParseVertex(const char *pos, const char *end,
+                                  Chunk &chunk) {
+  float x, y, z;
+  if ((pos = ParseFloat(pos, end, x)) && (pos = ParseFloat(pos, end, y)) &&
+      ParseFloat(pos, end, z)) {
+    chunk.vertexes.push_back(x);
+    chunk.vertexes.push_back(y);
+    chunk.vertexes.push_back(z);
+  }
+}
+
+void OpenFileCommand::ParseVertex(const char *line, const char *eol,
+                                  const char *text,
+                                  const std::uint16_t *tokens,
+                                  std::size_t count, Chunk &chunk) {
+  float xyz[3];
+  for (std::size_t i = 0; i < 3; ++i) {
+    if (i == count) return;
+    const char *token = text + tokens[i];
+    const char *next = ParseFloat(token, eol, xyz[i]);
+    if (!next) return;
+    // "1-2" holds two numbers for operator>>, leave such lines to it
+    if (next != eol && !IsBlank(*next)) {
+      ParseVertex(line + 2, eol, chunk);
+      return;
+    }
+  }
+  chunk.vertexes.insert(chunk.vertexes.end(), xyz, xyz + 3);
+}
+
+void OpenFileCommand::ParseFacet(const char *eol, const char *text,
+                                 const std::uint16_t *tokens,
+                                 std::size_t count, Chunk &chunk) {
+  if (WithSyntax(chunk.syntax, [&](auto syntax) {
+        return ParseFacetAs<decltype(syntax)::value>(eol, text, tokens, count,
+                                                     chunk);
+      })) {
+    return;
+  }
+  if (count) chunk.syntax = DetectSyntax(text + tokens[0], eol);
+  ParseAnyFacet(eol, text, tokens, count, chunk);
+}
+
+void OpenFileCommand::ParseAnyFacet(const char *eol, const char *text,
+                                    const std::uint16_t *tokens,
+                                    std::size_t count, Chunk &chunk) {
+  ++chunk.generic_faces;
+  int nums[3];
+  if (count < 3) return;
+  for (std::size_t i = 0; i < 3; ++i) {
+    if (!ReadIndex(text + tokens[i], eol, nums[i])) return;
+  }
+  PushIndex(nums[0], chunk);
+  PushIndex(nums[1], chunk);
+  PushIndex(nums[1], chunk);
+  PushIndex(nums[2], chunk);
+  PushIndex(nums[2], chunk);
+  int num;
+  for (std::size_t i = 3; i < count && ReadIndex(text + tokens[i], eol, num);
+       ++i) {
+    PushIndex(num, chunk);
+    PushIndex(num, chunk);
+  }
+  PushIndex(nums[0], chunk);
+}
+
+void OpenFileCommand::ParseFacet(const char *pos, const char *end,
+                                 Chunk &chunk) {
+  if (WithSyntax(chunk.syntax, [&](auto syntax) {
+        return ParseFacetAs<decltype(syntax)::value>(pos, end, chunk);
+      })) {
+    return;
+  }
+  chunk.syntax = DetectSyntax(pos, end);
+  ParseAnyFacet(pos, end, chunk);
+}
+
+template <class Parse>
+bool OpenFileCommand::WithSyntax(FaceSyntax syntax, const Parse &parse) {
+  switch (syntax) {
+    case FaceSyntax::kV:
+      return parse(std::integral_constant<FaceSyntax, FaceSyntax::kV>());
+    case FaceSyntax::kVt:
+      return parse(std::integral_constant<FaceSyntax, FaceSyntax::kVt>());
+    case FaceSyntax::kVn:
+      return parse(std::integral_constant<FaceSyntax, FaceSyntax::kVn>());
+    case FaceSyntax::kVtVn:
+      return parse(std::integral_constant<FaceSyntax, FaceSyntax::kVtVn>());
+    case FaceSyntax::kUnknown:
+      break;
+  }
+  return false;
+}
+
+template <OpenFileCommand::FaceSyntax kSyntax>
+bool OpenFileCommand::ParseFacetAs(const char *pos, const char *end,
+                                   Chunk &chunk) {
+  int nums[kMaxCorners];
+  std::size_t count = 0;
+  while ((pos = SkipBlanks(pos, end)) != end) {
+    if (count == kMaxCorners ||
+        !(pos = ReadShortIndex(pos, end, nums[count])) ||
+        !(pos = SkipAttributes<kSyntax>(pos, end)) ||
+        (pos != end && !IsBlank(*pos))) {
+      return false;
+    }
+    ++count;
+  }
+  if (count < 3) return false;
+  AddFacet(nums, count, chunk);
+  return true;
+}
+
+template <OpenFileCommand::FaceSyntax kSyntax>
+bool OpenFileCommand::ParseFacetAs(const char *eol, const char *text,
+                                   const std::uint16_t *tokens,
+                                   std::size_t count, Chunk &chunk) {
+  if (count < 3 || count > kMaxCorners) return false;
+  int nums[kMaxCorners];
+  for (std::size_t i = 0; i < count; ++i) {
+    const char *pos = ReadShortIndex(text + tokens[i], eol, nums[i]);
+    if (!pos || !(pos = SkipAttributes<kSyntax>(pos, eol)) ||
+        (pos != eol && !IsBlank(*pos))) {
+      return false;
+    }
+  }
+  AddFacet(nums, count, chunk);
+  return true;
+}
+
+void OpenFileCommand::AddFacet(const int *nums, std::size_t count,
+                               Chunk &chunk) {
+  // the corners are known, written at once instead of pushed one by one
+  const std::size_t first = chunk.facetes.size();
+  chunk.facetes.resize(first + 2 * count);
+  unsigned *out = chunk.facetes.data() + first;
+  out[0] = ResolveIndex(nums[0], first, chunk);
+  for (std::size_t i = 1; i < count; ++i) {
+    out[2 * i - 1] = ResolveIndex(nums[i], first + 2 * i - 1, chunk);
+    out[2 * i] = ResolveIndex(nums[i], first + 2 * i, chunk);
+  }
+  out[2 * count - 1] = ResolveIndex(nums[0], first + 2 * count - 1, chunk);
+}
+
+template <OpenFileCommand::FaceSyntax kSyntax>
+const char *OpenFileCommand::SkipAttributes(const char *pos,
+                                            const char *end) {
+  if constexpr (kSyntax == FaceSyntax::kVt || kSyntax == FaceSyntax::kVtVn) {
+    if (pos == end || *pos != '/' || !(pos = SkipAttribute(pos + 1, end))) {
+      return nullptr;
+    }
+  }
+  if constexpr (kSyntax == FaceSyntax::kVn) {
+    if (end - pos < 2 || pos[0] != '/' || pos[1] != '/') return nullptr;
+    pos = SkipAttribute(pos + 2, end);
+  }
+  if constexpr (kSyntax == FaceSyntax::kVtVn) {
+    if (pos == end || *pos != '/') return nullptr;
+    pos = SkipAttribute(pos + 1, end);
+  }
+  return pos;
+}
+
+OpenFileCommand::FaceSyntax OpenFileCommand::DetectSyntax(const char *pos,
+                                                          const char *end) {
+  int num;
+  pos = ReadShortIndex(SkipBlanks(pos, end), end, num);
+  if (!pos) return FaceSyntax::kUnknown;
+  auto ends = [end](const char *next) {
+    return next && (next == end || IsBlank(*next));
+  };
+  if (ends(SkipAttributes<FaceSyntax::kV>(pos, end))) return FaceSyntax::kV;
+  if (ends(SkipAttributes<FaceSyntax::kVt>(pos, end))) return FaceSyntax::kVt;
+  if (ends(SkipAttributes<FaceSyntax::kVn>(pos, end))) return FaceSyntax::kVn;
+  if (ends(SkipAttributes<FaceSyntax::kVtVn>(pos, end))) {
+    return FaceSyntax::kVtVn;
+  }
+  return FaceSyntax::kUnknown;
+}
+
+void OpenFileCommand::ParseAnyFacet(const char *pos, const char *end,
+                                    Chunk &chunk) {
+  ++chunk.generic_faces;
+  int nums[3];
+  for (int &num : nums) {
+    pos = SkipBlanks(pos, end);
+    if (pos == end || !(pos = ParseIndex(pos, end, num))) return;
+  }
+  PushIndex(nums[0], chunk);
+  PushIndex(nums[1], chunk);
+  PushIndex(nums[1], chunk);
+  PushIndex(nums[2], chunk);
+  PushIndex(nums[2], chunk);
+  int num;
+  while ((pos = SkipBlanks(pos, end)) != end &&
+         (pos = ParseIndex(pos, end, num))) {
+    PushIndex(num, chunk);
+    PushIndex(num, chunk);
+  }
+  PushIndex(nums[0], chunk);
+}
+
+void OpenFileCommand::ParseGroup(const char *pos, const char *end,
+                                 Chunk &chunk) {
+  pos = SkipBlanks(pos, end);
+  while (end != pos && IsBlank(end[-1])) --end;
+  Group group;
+  group.name.assign(pos, end);
+  group.first = chunk.facetes.size();
+  chunk.groups.push_back(std::move(group));
+}
+
+void OpenFileCommand::PushIndex(int num, Chunk &chunk) {
+  chunk.facetes.push_back(ResolveIndex(num, chunk.facetes.size(), chunk));
+}
+
+inline unsigned OpenFileCommand::ResolveIndex(int num, std::size_t position,
+                                              Chunk &chunk) {
+  if (num < 0) {
+    // relative to the vertices read so far, the chunk's own ones are known
+    // here, the ones before the chunk are added in MergeChunks
+    if (!chunk.direct) chunk.relative.push_back(unsigned(position));
+    num += int(chunk.vertexes.size() / 3) + 1;
+  }
+  return unsigned(num);
+}
+
+unsigned IndexBuffer::at(std::size_t i) const noexcept {
+  auto batch = std::upper_bound(
+      batches.begin(), batches.end(), i,
+      [](std::size_t pos, const Batch &batch) { return pos < batch.first; });
+  unsigned base = batch == batches.begin() ? 0 : std::prev(batch)->base;
+  const unsigned char *pos = data.data() + i * width;
+  if (width == 1) return base + *pos;
+  if (width == 2) {
+    std::uint16_t num;
+    std::memcpy(&num, pos, sizeof(num));
+    return base + num;
+  }
+  unsigned num;
+  std::memcpy(&num, pos, sizeof(num));
+  return base + num;
+}
+
+IndexBuffer IndexBuffer::Pack(const facet &indexes, std::size_t vertex_count) {
+  constexpr std::size_t kShortRange = 1 << 16;
+  IndexBuffer result;
+  result.width = vertex_count <= 1 << 8        ? 1
+                 : vertex_count <= kShortRange ? 2
+                                               : 4;
+  result.batches.push_back({0, indexes.size(), 0});
+  if (result.width == 4) {
+    // cut at line boundaries wherever the next line leaves the 16-bit range
+    std::vector<Batch> batches;
+    const std::size_t max_batches = indexes.size() / kMinBatch;
+    unsigned low = 0, high = 0;
+    for (std::size_t i = 0; i < indexes.size(); i += 2) {
+      auto end = std::min(i + 2, indexes.size());
+      auto [line_low, line_high] =
+          std::minmax_element(indexes.begin() + i, indexes.begin() + end);
+      if (*line_high - *line_low >= kShortRange) {
+        // no batch can hold this line in 16 bits
+        batches.clear();
+        break;
+      }
+      if (batches.empty() || std::max(high, *line_high) -
+                                     std::min(low, *line_low) >= kShortRange) {
+        if (batches.size() == max_batches) {
+          // too short to pay for the extra draw calls
+          batches.clear();
+          break;
+        }
+        if (!batches.empty()) batches.back().count = i - batches.back().first;
+        batches.push_back({i, 0, 0});
+        low = *line_low;
+        high = *line_high;
+      } else {
+        low = std::min(low, *line_low);
+        high = std::max(high, *line_high);
+      }
+      batches.back().base = low;
+    }
+    if (!batches.empty()) {
+      batches.back().count = indexes.size() - batches.back().first;
+      result.width = 2;
+      result.batches = std::move(batches);
+    }
+  }
+
+  result.data.resize(indexes.size() * result.width);
+  for (const auto &batch : result.batches) {
+    auto *from = indexes.data() + batch.first;
+    auto *to = result.data.data() + batch.first * result.width;
+    if (result.width == 1) {
+      std::transform(from, from + batch.count, to,
+                     [](unsigned num) { return std::uint8_t(num); });
+    } else if (result.width == 2) {
+      for (std::size_t i = 0; i != batch.count; ++i) {
+        auto num = std::uint16_t(from[i] - batch.base);
+        std::memcpy(to + 2 * i, &num, sizeof(num));
+      }
+    } else {
+      std::memcpy(to, from, batch.count * sizeof(unsigned));
+    }
+  }
+  return result;
+}
+
+QuantizedVertexes QuantizedVertexes::Quantize(
+    const vertex &vertexes, const std::array<float, 3> &lower,
+    const std::array<float, 3> &upper) {
+  QuantizedVertexes result;
+  float steps[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    result.offset[axis] = lower[axis];
+    result.scale[axis] = upper[axis] - lower[axis];
+    steps[axis] = result.scale[axis] > 0 ? 65535.0f / result.scale[axis] : 0;
+  }
+  result.data.resize(vertexes.size());
+  for (std::size_t i = 0; i < vertexes.size(); ++i) {
+    float step = std::clamp((vertexes[i] - lower[i % 3]) * steps[i % 3], 0.0f,
+                            65535.0f);
+    result.data[i] = std::uint16_t(std::lround(step));
+    result.error =
+        std::max(result.error, std::fabs(result.at(i) - vertexes[i]));
+  }
+  return result;
 }
 
 void OpenFileCommand::execute() {
-  Open();
-  ReadObj();
-  if (result_.vertexes->empty())
-    throw std::runtime_error("Wrong data in the file.");
+  StageTimer total(result_.timings.total);
+  result_.timings = LoadTimings{};
+  MeshCache cache(options_.cache_dir, options_.cache_limit,
+                  options_.cache_compress, CacheVariant());
+  bool cached = false;
+  if (options_.use_cache) {
+    StageTimer timer(result_.timings.read);
+    cached = cache.Load(filename_, result_);
+  }
+  if (!cached) {
+    try {
+      Open();
+      ReadObj();
+      if (result_.vertexes->empty())
+        throw std::runtime_error("Wrong data in the file.");
+    } catch (...) {
+      result_ = Obj{};
+      throw;
+    }
+    if (options_.use_cache) cache.Store(filename_, result_);
+  }
+  StageTimer timer(result_.timings.pack);
+  if (options_.pack_indexes) {
+    result_.indexes = std::make_unique<IndexBuffer>(
+        IndexBuffer::Pack(*result_.facetes, result_.vertexes->size() / 3));
+    result_.facetes.reset();
+  }
+  if (options_.quantize) {
+    result_.quantized =
+        std::make_unique<QuantizedVertexes>(QuantizedVertexes::Quantize(
+            *result_.vertexes, result_.bounds.lower, result_.bounds.upper));
+    result_.vertexes.reset();
+  }
 }
 void RotateCommand::execute() {
-  S21Matrix mx{S21Matrix::Init4x4fv(matrix_)};
-
-  S21Matrix rotation_matrix(4, 4);
-  rotation_matrix(0, 0) = cosf(angle_[1]) * cosf(angle_[2]);
-  rotation_matrix(0, 1) = -sinf(angle_[2]) * cosf(angle_[1]);
-  rotation_matrix(0, 2) = sinf(angle_[1]);
-  rotation_matrix(1, 0) = sinf(angle_[0]) * sinf(angle_[1]) * cosf(angle_[2]) +
-                          sinf(angle_[2]) * cosf(angle_[0]);
-  rotation_matrix(1, 1) = -sinf(angle_[0]) * sinf(angle_[1]) * sinf(angle_[2]) +
-                          cosf(angle_[2]) * cosf(angle_[0]);
-  rotation_matrix(1, 2) = -sinf(angle_[0]) * cosf(angle_[1]);
-  rotation_matrix(2, 0) = sinf(angle_[0]) * sinf(angle_[2]) -
-                          sinf(angle_[1]) * cosf(angle_[0]) * cosf(angle_[2]);
-  rotation_matrix(2, 1) = sinf(angle_[0]) * cosf(angle_[2]) +
-                          sinf(angle_[1]) * cosf(angle_[0]) * sinf(angle_[2]);
-  rotation_matrix(2, 2) = cosf(angle_[0]) * cosf(angle_[1]);
-  rotation_matrix(3, 3) = 1.0f;
-  mx = rotation_matrix.Transpose() * mx;
-  std::copy_n(mx.GetPointer(), 16, matrix_);
-}
-void ScaleCommand::execute() {
-  S21Matrix mx{S21Matrix::Init4x4fv(matrix_)};
-  S21Matrix scaling_matrix(4, 4);
-  scaling_matrix(0, 0) = factor_;
-  scaling_matrix(1, 1) = factor_;
-  scaling_matrix(2, 2) = factor_;
-  scaling_matrix(3, 3) = 1.0;
-  mx *= scaling_matrix;
-  std::copy_n(mx.GetPointer(), 16, matrix_);
+  pose_.Rotate(angle_[0], angle_[1], angle_[2]);
 }
+void ScaleCommand::execute() { pose_.Scale(factor_); }
 void TranslateCommand::execute() {
-  S21Matrix mx{S21Matrix::Init4x4fv(matrix_)};
-  S21Matrix translating_matrix = S21Matrix::CreateIdentity(4);
-  translating_matrix(3, 0) = vec_[0];
-  translating_matrix(3, 1) = vec_[1];
-  translating_matrix(3, 2) = vec_[2];
-  translating_matrix(3, 3) = 1.0f;
-  mx = translating_matrix.Transpose() * mx;
-  std::copy_n(mx.GetPointer(), 16, matrix_);
+  pose_.Translate(vec_[0], vec_[1], vec_[2]);
 }
 void GenOrthoCommand::execute() {
-  auto *ortho_matrix = new S21Matrix(S21Matrix::CreateIdentity(4));
-  (*ortho_matrix)(0, 0) = 2.0f / (right_ - left_);
-  (*ortho_matrix)(1, 1) = 2.0f / (top_ - bottom_);
-  (*ortho_matrix)(2, 2) = -2.0f / (far_ - near_);
-  (*ortho_matrix)(3, 0) = -(right_ + left_) / (right_ - left_);
-  (*ortho_matrix)(3, 1) = -(top_ + bottom_) / (top_ - bottom_);
-  (*ortho_matrix)(3, 2) = -(far_ + near_) / (far_ - near_);
-  result_ = new float[16];
-  std::copy_n(ortho_matrix->GetPointer(), 16, result_);
+  result_ = Mat4::Ortho(left_, right_, bottom_, top_, near_, far_);
 }
 void Model::ExecuteCommand(Command *command) {
-  command->execute();
-  delete command;
+  std::unique_ptr<Command> owner(command);
+  owner->execute();
 }
 void GenPerspectiveCommand::execute() {
-  auto *perspective_matrix = new S21Matrix(S21Matrix::CreateIdentity(4));
-  (*perspective_matrix)(0, 0) = 1 / (aspect_ * tanf(fov_ / 2));
-  (*perspective_matrix)(1, 1) = 1 / (tanf(fov_ / 2));
-  (*perspective_matrix)(2, 2) = far_ / (near_ - far_);
-  (*perspective_matrix)(2, 3) = -1.0f;
-  (*perspective_matrix)(3, 2) = -(2 * far_ * near_) / (far_ - near_);
-  result_ = new float[16];
-  std::copy_n(perspective_matrix->GetPointer(), 16, result_);
+  result_ = Mat4::Perspective(fov_, aspect_, near_, far_);
 }
 }  // namespace s21
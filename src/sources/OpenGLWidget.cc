@@ -4,6 +4,11 @@
 
 #include "OpenGLWidget.h"
 
+#include <algorithm>
+
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLVersionFunctionsFactory>
+
 namespace s21 {
 
 OpenGLWidget::OpenGLWidget(QWidget *parent) : QOpenGLWidget(parent) {}
@@ -13,7 +18,6 @@ OpenGLWidget::~OpenGLWidget() {
   glDeleteBuffers(1, &VBO);
   glDeleteBuffers(1, &IBO);
   lines_shader.DeleteShader();
-  FreeBuffers();
 }
 
 void OpenGLWidget::initializeGL() {
@@ -24,18 +28,28 @@ void OpenGLWidget::initializeGL() {
                           "./shaders/point_fragment_shader");
   CreateBuffers();
   glEnable(GL_DEPTH_TEST);
-  SetStrategy(std::make_unique<s21::VertexStrategy>());
   if (!conf.filename.isEmpty()) emit OpenFileSignal(conf.filename);
 }
 
 void OpenGLWidget::SetBuffers() {
+  glBindVertexArray(VAO);
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, int(sizeof(float) * vertexes->size()),
-               vertexes->data(), GL_STATIC_DRAW);
+  if (quantized) {
+    glBufferData(GL_ARRAY_BUFFER,
+                 GLsizeiptr(sizeof(std::uint16_t) * quantized->size()),
+                 quantized->data.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                          sizeof(std::uint16_t) * 3, nullptr);
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(sizeof(float) * vertexes->size()),
+                 vertexes->data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, nullptr);
+  }
 
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, int(facetes->size() * sizeof(unsigned)),
-               facetes->data(), GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexes->data.size()),
+               indexes->data.data(), GL_STATIC_DRAW);
+  glBindVertexArray(0);
 }
 
 void OpenGLWidget::resizeGL(int w, int h) { glViewport(0, 0, w, h); }
@@ -44,49 +58,124 @@ void OpenGLWidget::paintGL() {
   glClearColor(conf.colors[0].redF(), conf.colors[0].greenF(),
                conf.colors[0].blueF(), 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  if (vertexes) {
-    SetPerspectiveMatrix();
-    mvp_ = projection_.Transpose() * view_.Transpose() * identity_;
+  if (indexes) {
+    // rebuilt only when the projection kind changes
+    camera_.SetProjection(conf.parallel, kAspect);
+    mvp_ = camera_.Mvp(pose_);
     glBindVertexArray(VAO);
 
-    SetStrategy(std::make_unique<s21::LinesStrategy>());
+    SetStrategy(&lines_strategy_);
     current_render_strategy_->Render(lines_shader, mvp_, conf,
-                                     int(facetes->size()));
+                                     int(indexes->size()));
 
     if (conf.vertices) {
-      SetStrategy(std::make_unique<s21::VertexStrategy>());
+      SetStrategy(&vertex_strategy_);
+      auto size = quantized ? quantized->size() : vertexes->size();
       current_render_strategy_->Render(point_shader, mvp_, conf,
-                                       int(vertexes->size() / 3));
+                                       int(size / 3));
     }
     glBindVertexArray(0);
   }
 }
-void OpenGLWidget::SetPerspectiveMatrix() {
-  if (conf.parallel) {
-    emit GetOrthoMatrix(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 100.0f);
-  } else {
-    emit GetPerspectiveMatrix((60.0f * M_PI) / 180, 600.0f / 800.0f, 1, 100.0f);
-  }
-  projection_ = std::move(*needed_matrix_);
-  delete needed_matrix_;
-  needed_matrix_ = nullptr;
-}
-void OpenGLWidget::SetObj(const vertex *vx, const facet *ft, const float &min,
-                          const float &max) {
-  FreeBuffers();
-  facetes = ft;
-  vertexes = vx;
-  float norm_half = (max - min) / 2;
-  auto norm_mid = float(float(min + norm_half) * 0.75 / norm_half);
-  identity_ = s21::S21Matrix::CreateIdentity(4);
-  ScaleObject(0.75f / norm_half);
-  TranslateObject(std::vector<float>{-norm_mid, -norm_mid, -norm_mid});
+void OpenGLWidget::SetObj(Obj obj) {
+  makeCurrent();
+  indexes = std::move(obj.indexes);
+  vertexes = std::move(obj.vertexes);
+  quantized = std::move(obj.quantized);
+  groups_ = std::move(obj.groups);
+  visible_.assign(groups_.size(), true);
+  UpdateDrawList();
+  const auto offset =
+      quantized ? quantized->offset : std::array<float, 3>{0, 0, 0};
+  const auto scale =
+      quantized ? quantized->scale : std::array<float, 3>{1, 1, 1};
+  lines_strategy_.SetPosition(offset, scale);
+  vertex_strategy_.SetPosition(offset, scale);
+  const auto &bounds = obj.bounds;
+  // the sphere keeps the model in view whichever way it is rotated
+  float norm_half = bounds.radius > 0 ? bounds.radius : bounds.HalfSize();
+  if (!(norm_half > 0)) norm_half = 1;
+  float scale = 0.75f / norm_half;
+  auto center = bounds.Center();
+  pose_ = s21::Pose();
+  ScaleObject(scale);
+  TranslateObject(std::vector<float>{-center[0] * scale, -center[1] * scale,
+                                     -center[2] * scale});
   SetBuffers();
+  doneCurrent();
+}
+
+void OpenGLWidget::SetGroupVisible(std::size_t group, bool visible) {
+  if (group >= visible_.size() || visible_[group] == visible) return;
+  visible_[group] = visible;
+  UpdateDrawList();
+  update();
+}
+
+void OpenGLWidget::UpdateDrawList() {
+  draws_ = DrawList{};
+  points_ = PointList{};
+  if (!indexes) return;
+  UpdatePointList();
+  draws_.type = indexes->width == 1   ? GL_UNSIGNED_BYTE
+                : indexes->width == 2 ? GL_UNSIGNED_SHORT
+                                      : GL_UNSIGNED_INT;
+  std::vector<std::pair<std::size_t, std::size_t>> ranges;
+  if (groups_.empty() && indexes->size()) {
+    ranges.emplace_back(0, indexes->size());
+  }
+  for (std::size_t i = 0; i < groups_.size(); ++i) {
+    if (!visible_[i] || !groups_[i].count) continue;
+    auto begin = groups_[i].first, end = begin + groups_[i].count;
+    if (!ranges.empty() && ranges.back().second == begin) {
+      ranges.back().second = end;
+    } else {
+      ranges.emplace_back(begin, end);
+    }
+  }
+  // batches and ranges are both sorted, walk them together
+  auto batch = indexes->batches.begin();
+  for (auto [begin, end] : ranges) {
+    while (batch->first + batch->count <= begin) ++batch;
+    for (auto part = batch; part != indexes->batches.end() &&
+                            part->first < end;
+         ++part) {
+      auto from = std::max(begin, part->first);
+      auto to = std::min(end, part->first + part->count);
+      draws_.counts.push_back(GLsizei(to - from));
+      draws_.offsets.push_back(
+          reinterpret_cast<const void *>(from * indexes->width));
+      draws_.bases.push_back(GLint(part->base));
+    }
+  }
 }
 
-void OpenGLWidget::FreeBuffers() {
-  delete vertexes;
-  delete facetes;
+void OpenGLWidget::UpdatePointList() {
+  const auto size = (quantized ? quantized->size() : vertexes->size()) / 3;
+  // vertices no face uses belong to no group, keep them while all are shown
+  if (std::find(visible_.begin(), visible_.end(), false) == visible_.end()) {
+    if (size) {
+      points_.firsts.push_back(0);
+      points_.counts.push_back(GLsizei(size));
+    }
+    return;
+  }
+  std::vector<std::pair<unsigned, unsigned>> ranges;
+  for (std::size_t i = 0; i < groups_.size(); ++i) {
+    if (!visible_[i] || !groups_[i].count) continue;
+    auto begin = groups_[i].first_vertex;
+    ranges.emplace_back(begin, begin + groups_[i].vertex_count);
+  }
+  // groups may share vertices, so their ranges can overlap in any order
+  std::sort(ranges.begin(), ranges.end());
+  for (std::size_t i = 0; i < ranges.size();) {
+    auto [begin, end] = ranges[i];
+    for (++i; i < ranges.size() && ranges[i].first <= end; ++i) {
+      end = std::max(end, ranges[i].second);
+    }
+    points_.firsts.push_back(GLint(begin));
+    points_.counts.push_back(GLsizei(end - begin));
+  }
 }
 
 void OpenGLWidget::mousePressEvent(QMouseEvent *mo) { mPos = mo->pos(); }
@@ -119,15 +208,15 @@ void OpenGLWidget::wheelEvent(QWheelEvent *event) {
 }
 
 void OpenGLWidget::ScaleObject(const float &factor) {
-  ScaleMatrix(identity_.GetPointer(), factor);
+  ScaleMatrix(&pose_, factor);
 }
 
 void OpenGLWidget::TranslateObject(const std::vector<float> &vec) {
-  TranslateMatrix(identity_.GetPointer(), vec);
+  TranslateMatrix(&pose_, vec);
 }
 
 void OpenGLWidget::RotateObject(const std::vector<float> &vec) {
-  RotateMatrix(identity_.GetPointer(), vec);
+  RotateMatrix(&pose_, vec);
 }
 
 void OpenGLWidget::CreateBuffers() {
@@ -141,21 +230,20 @@ void OpenGLWidget::CreateBuffers() {
   glEnableVertexAttribArray(0);
   glBindVertexArray(0);
 }
-void OpenGLWidget::SetResultMatrix(float *result) {
-  needed_matrix_ = new s21::S21Matrix(s21::S21Matrix::Init4x4fv(result));
-}
 
 QDataStream &operator>>(QDataStream &in, s21::config &conf) {
   QByteArray ba_parallel, ba_solid, ba_vertices, ba_vertices_size,
-      ba_edges_thikness;
+      ba_edges_thikness, ba_quantize, ba_use_cache;
   in >> conf.filename >> conf.colors[0] >> conf.colors[1] >> conf.colors[2] >>
       ba_parallel >> ba_solid >> ba_vertices >> ba_vertices_size >>
-      ba_edges_thikness;
+      ba_edges_thikness >> ba_quantize >> ba_use_cache;
   conf.parallel = ba_parallel.toInt();
   conf.solid = ba_solid.toInt();
   conf.vertices = ba_vertices.toInt();
   conf.vertices_size = ba_vertices_size.toInt();
   conf.edges_thickness = ba_edges_thikness.toInt();
+  conf.quantize = ba_quantize.toInt();
+  conf.use_cache = ba_use_cache.toInt();
   return in;
 }
 QDataStream &operator<<(QDataStream &out, const s21::config &conf) {
@@ -163,11 +251,13 @@ QDataStream &operator<<(QDataStream &out, const s21::config &conf) {
       << QByteArray::number(conf.parallel) << QByteArray::number(conf.solid)
       << QByteArray::number(conf.vertices)
       << QByteArray::number(conf.vertices_size)
-      << QByteArray::number(conf.edges_thickness);
+      << QByteArray::number(conf.edges_thickness)
+      << QByteArray::number(conf.quantize)
+      << QByteArray::number(conf.use_cache);
   return out;
 }
-void s21::LinesStrategy::Render(QtShader shader, const S21Matrix &mvp,
-                                const config &conf, const int &size) {
+void s21::LinesStrategy::Render(QtShader shader, const Mat4 &mvp,
+                                const config &conf, const int & /*size*/) {
   shader.Use();
   initializeOpenGLFunctions();
 
@@ -175,16 +265,32 @@ void s21::LinesStrategy::Render(QtShader shader, const S21Matrix &mvp,
 
   shader.SetUniVariableI("u_solid", conf.solid);
 
+  SetPositionUniforms(shader);
+
   shader.SetUniVariable("u_mvp", mvp.GetPointer());
 
   shader.SetUniVec4Fl("u_color",
-                      std::vector<float>{(float)conf.colors[1].redF(),
-                                         (float)conf.colors[1].greenF(),
-                                         (float)conf.colors[1].blueF()});
-  glDrawElements(GL_LINES, size, GL_UNSIGNED_INT, nullptr);
+                      std::array<float, 3>{(float)conf.colors[1].redF(),
+                                           (float)conf.colors[1].greenF(),
+                                           (float)conf.colors[1].blueF()});
+  if (draws_->counts.empty()) return;
+  if (draws_->counts.size() == 1) {
+    glDrawElementsBaseVertex(GL_LINES, draws_->counts[0], draws_->type,
+                             draws_->offsets[0], draws_->bases[0]);
+  } else if (auto *gl = QOpenGLVersionFunctionsFactory::get<
+                 QOpenGLFunctions_3_3_Core>(QOpenGLContext::currentContext())) {
+    gl->glMultiDrawElementsBaseVertex(
+        GL_LINES, draws_->counts.data(), draws_->type, draws_->offsets.data(),
+        GLsizei(draws_->counts.size()), draws_->bases.data());
+  } else {
+    for (std::size_t i = 0; i < draws_->counts.size(); ++i) {
+      glDrawElementsBaseVertex(GL_LINES, draws_->counts[i], draws_->type,
+                               draws_->offsets[i], draws_->bases[i]);
+    }
+  }
 }
-void s21::VertexStrategy::Render(QtShader shader, const S21Matrix &mvp,
-                                 const config &conf, const int &size) {
+void s21::VertexStrategy::Render(QtShader shader, const Mat4 &mvp,
+                                 const config &conf, const int & /*size*/) {
   shader.Use();
   initializeOpenGLFunctions();
 
@@ -192,12 +298,26 @@ void s21::VertexStrategy::Render(QtShader shader, const S21Matrix &mvp,
 
   shader.SetUniVariableI("u_smooth", int(conf.vertices));
 
+  SetPositionUniforms(shader);
+
   shader.SetUniVariable("u_mvp", mvp.GetPointer());
 
   shader.SetUniVec4Fl("u_color",
-                      std::vector<float>{(float)conf.colors[2].redF(),
-                                         (float)conf.colors[2].greenF(),
-                                         (float)conf.colors[2].blueF()});
-  glDrawArrays(GL_POINTS, 0, size);
+                      std::array<float, 3>{(float)conf.colors[2].redF(),
+                                           (float)conf.colors[2].greenF(),
+                                           (float)conf.colors[2].blueF()});
+  if (points_->counts.empty()) return;
+  if (points_->counts.size() == 1) {
+    glDrawArrays(GL_POINTS, points_->firsts[0], points_->counts[0]);
+  } else if (auto *gl = QOpenGLVersionFunctionsFactory::get<
+                 QOpenGLFunctions_3_3_Core>(QOpenGLContext::currentContext())) {
+    gl->glMultiDrawArrays(GL_POINTS, points_->firsts.data(),
+                          points_->counts.data(),
+                          GLsizei(points_->counts.size()));
+  } else {
+    for (std::size_t i = 0; i < points_->counts.size(); ++i) {
+      glDrawArrays(GL_POINTS, points_->firsts[i], points_->counts[i]);
+    }
+  }
 }
 }  // namespace s21
\ No newline at end of file
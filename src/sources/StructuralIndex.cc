@@ -0,0 +1,201 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+#include "StructuralIndex.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define S21_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace s21 {
+
+namespace {
+
+constexpr std::size_t kLanes = 64;
+
+/**
+ * @struct Masks
+ * @brief one bit per char of a 64 char block
+ */
+struct Masks {
+  /// blanks and line breaks, the chars between tokens
+  std::uint64_t separators = 0;
+  std::uint64_t breaks = 0;
+};
+
+/**
+ * Writes the positions of the token starts and line breaks of a block
+ * @param carry - whether the char before the block was a separator, updated
+ * for the next block
+ * @return count plus the positions written
+ */
+inline std::size_t Emit(const Masks &masks, std::size_t offset,
+                        std::uint64_t &carry, std::uint16_t *out,
+                        std::size_t count) noexcept {
+  std::uint64_t starts =
+      ~masks.separators & (masks.separators << 1 | carry);
+  carry = masks.separators >> 63;
+  for (std::uint64_t bits = starts | masks.breaks; bits; bits &= bits - 1) {
+    out[count++] = std::uint16_t(offset + std::size_t(__builtin_ctzll(bits)));
+  }
+  return count;
+}
+
+/**
+ * Runs the kernel over the whole 64 char blocks, then over the tail padded
+ * with blanks, which start no tokens
+ */
+template <class Kernel>
+inline std::size_t IndexBlocks(const char *text, std::size_t size,
+                               std::uint16_t *out, Kernel kernel) noexcept {
+  std::uint64_t carry = 1;
+  std::size_t count = 0, i = 0;
+  for (; i + kLanes <= size; i += kLanes) {
+    count = Emit(kernel(text + i), i, carry, out, count);
+  }
+  if (i != size) {
+    char tail[kLanes];
+    std::memset(tail, ' ', kLanes);
+    std::memcpy(tail, text + i, size - i);
+    count = Emit(kernel(tail), i, carry, out, count);
+  }
+  return count;
+}
+
+Masks ScalarMasks(const char *text) noexcept {
+  Masks masks;
+  for (std::size_t i = 0; i < kLanes; ++i) {
+    // '\t', '\n', '\v', '\f' and '\r' are 9 to 13
+    auto c = static_cast<unsigned char>(text[i]);
+    std::uint64_t bit = std::uint64_t(1) << i;
+    if (c == ' ' || (c >= '\t' && c <= '\r')) masks.separators |= bit;
+    if (c == '\n') masks.breaks |= bit;
+  }
+  return masks;
+}
+
+std::size_t IndexScalar(const char *text, std::size_t size,
+                        std::uint16_t *out) noexcept {
+  return IndexBlocks(text, size, out, ScalarMasks);
+}
+
+#ifdef __SSE2__
+inline Masks Sse2Masks(const char *text) noexcept {
+  // adding 128 - 9 moves '\t' .. '\r' to the bottom of the signed range
+  const __m128i shift = _mm_set1_epi8(char(128 - '\t'));
+  const __m128i limit = _mm_set1_epi8(char(-128 + 5));
+  const __m128i space = _mm_set1_epi8(' '), eol = _mm_set1_epi8('\n');
+  Masks masks;
+  for (int j = 0; j < 4; ++j) {
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text) + j);
+    __m128i controls = _mm_cmplt_epi8(_mm_add_epi8(c, shift), limit);
+    __m128i separators = _mm_or_si128(controls, _mm_cmpeq_epi8(c, space));
+    masks.separators |=
+        std::uint64_t(unsigned(_mm_movemask_epi8(separators))) << (16 * j);
+    masks.breaks |=
+        std::uint64_t(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(c, eol))))
+        << (16 * j);
+  }
+  return masks;
+}
+
+std::size_t IndexSse2(const char *text, std::size_t size,
+                      std::uint16_t *out) noexcept {
+  return IndexBlocks(text, size, out, Sse2Masks);
+}
+#endif
+
+#ifdef S21_X86_DISPATCH
+__attribute__((target("avx2"))) inline Masks Avx2Masks(
+    const char *text) noexcept {
+  const __m256i shift = _mm256_set1_epi8(char(128 - '\t'));
+  const __m256i limit = _mm256_set1_epi8(char(-128 + 5));
+  const __m256i space = _mm256_set1_epi8(' '), eol = _mm256_set1_epi8('\n');
+  Masks masks;
+  for (int j = 0; j < 2; ++j) {
+    __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text) + j);
+    __m256i controls = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(c, shift));
+    __m256i separators = _mm256_or_si256(controls, _mm256_cmpeq_epi8(c, space));
+    masks.separators |=
+        std::uint64_t(unsigned(_mm256_movemask_epi8(separators))) << (32 * j);
+    masks.breaks |=
+        std::uint64_t(unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, eol))))
+        << (32 * j);
+  }
+  return masks;
+}
+
+__attribute__((target("avx2"))) std::size_t IndexAvx2(
+    const char *text, std::size_t size, std::uint16_t *out) noexcept {
+  // spelled out instead of IndexBlocks, the kernel is only inlined into a
+  // caller compiled for AVX2 too
+  std::uint64_t carry = 1;
+  std::size_t count = 0, i = 0;
+  for (; i + kLanes <= size; i += kLanes) {
+    count = Emit(Avx2Masks(text + i), i, carry, out, count);
+  }
+  if (i != size) {
+    char tail[kLanes];
+    std::memset(tail, ' ', kLanes);
+    std::memcpy(tail, text + i, size - i);
+    count = Emit(Avx2Masks(tail), i, carry, out, count);
+  }
+  return count;
+}
+#endif
+
+}  // namespace
+
+StructuralIndex::Isa StructuralIndex::Best() noexcept {
+  static const Isa best = Supported(Isa::kAvx2)   ? Isa::kAvx2
+                          : Supported(Isa::kSse2) ? Isa::kSse2
+                                                  : Isa::kScalar;
+  return best;
+}
+
+bool StructuralIndex::Supported(Isa isa) noexcept {
+  switch (isa) {
+#ifdef __SSE2__
+    case Isa::kSse2:
+      return true;
+#endif
+#ifdef S21_X86_DISPATCH
+    case Isa::kAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    case Isa::kScalar:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void StructuralIndex::Build(const char *text, std::size_t size, Isa isa) {
+  if (size > kMaxBlock) throw std::runtime_error("Block is too large.");
+  if (positions_.size() < kMaxBlock) positions_.resize(kMaxBlock);
+  switch (isa) {
+#ifdef S21_X86_DISPATCH
+    case Isa::kAvx2:
+      size_ = IndexAvx2(text, size, positions_.data());
+      break;
+#endif
+#ifdef __SSE2__
+    case Isa::kSse2:
+      size_ = IndexSse2(text, size, positions_.data());
+      break;
+#endif
+    default:
+      size_ = IndexScalar(text, size, positions_.data());
+  }
+}
+
+}  // namespace s21
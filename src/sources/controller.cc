@@ -8,61 +8,98 @@ namespace s21 {
 controller::controller(Model *model, viewer *view, QObject *parent)
     : QObject(parent), model_{model}, view_{view} {
   connect(view_, &viewer::OpenFileSignal, this, &controller::OpenFile);
+  connect(view_, &viewer::CancelOpenSignal, this, &controller::CancelOpen);
   connect(view_, &viewer::RotateMatrix, this, &controller::Rotate);
   connect(view_, &viewer::TranslateMatrix, this, &controller::Translate);
   connect(view_, &viewer::ScaleMatrix, this, &controller::Scale);
-  connect(view_, &viewer::GetOrthoMatrix, this, &controller::GetOrtho);
-  connect(view_, &viewer::GetPerspectiveMatrix, this,
-          &controller::GetPerspective);
 }
 
-void controller::OpenFile(const QString &filename) const {
-  Obj result;
-  Command *command;
-  try {
-    command = new OpenFileCommand(filename.toStdString(), result);
-    model_->ExecuteCommand(command);
-    viewer::obj input;
-    input.vertexes = result.vertexes;
-    input.facetes = result.facetes;
-    input.min = result.min;
-    input.max = result.max;
-    view_->SetResult(input);
-  } catch (std::exception &e) {
-    view_->SetError(e.what());
+controller::~controller() {
+  CancelOpen();
+  for (auto &loader : loaders_) {
+    if (loader) loader->wait();
   }
 }
-void controller::Rotate(float *mx, const std::vector<float> &vec) const {
-  Command *command;
-  command = new RotateCommand(mx, vec);
-  model_->ExecuteCommand(command);
+
+void controller::OpenFile(const QString &filename, bool quantize,
+                          bool use_cache) {
+  CancelOpen();
+  loaders_.removeIf(
+      [](const QPointer<QThread> &loader) { return loader.isNull(); });
+  auto cancel = cancel_ = std::make_shared<std::atomic<bool>>(false);
+  unsigned generation = ++generation_;
+
+  QThread *loader = QThread::create([this, filename, quantize, use_cache,
+                                     cancel, generation] {
+    Obj result;
+    QString error;
+    LoadOptions options;
+    options.use_cache = use_cache;
+    options.weld = true;
+    options.unique_edges = true;
+    options.pack_indexes = true;
+    options.quantize = quantize;
+    options.bounding_sphere = true;
+    options.cancel = cancel.get();
+    options.progress = [this, generation](std::size_t done,
+                                          std::size_t total) {
+      QMetaObject::invokeMethod(
+          this,
+          [this, generation, done, total] {
+            if (generation == generation_) view_->SetProgress(done, total);
+          },
+          Qt::QueuedConnection);
+    };
+    try {
+      model_->ExecuteCommand(
+          new OpenFileCommand(filename.toStdString(), result, options));
+    } catch (std::exception &e) {
+      error = e.what();
+    }
+    // queued calls copy their functor, the mesh itself is only moved
+    auto shared = std::make_shared<Obj>(std::move(result));
+    QMetaObject::invokeMethod(
+        this,
+        [this, generation, shared, error] {
+          FinishOpen(generation, std::move(*shared), error);
+        },
+        Qt::QueuedConnection);
+  });
+  connect(loader, &QThread::finished, loader, &QObject::deleteLater);
+  loaders_.append(loader);
+  loader->start();
 }
-void controller::Translate(float *mx, const std::vector<float> &vec) const {
-  Command *command;
-  command = new TranslateCommand(mx, vec);
-  model_->ExecuteCommand(command);
+
+void controller::CancelOpen() {
+  if (cancel_) *cancel_ = true;
+  cancel_.reset();
+}
+
+void controller::FinishOpen(unsigned generation, Obj result,
+                            const QString &error) {
+  if (generation != generation_) return;
+  cancel_.reset();
+  if (!error.isEmpty()) {
+    view_->SetError(error.toStdString());
+    return;
+  }
+  view_->SetResult(std::move(result));
 }
-void controller::Scale(float *mx, const float &factor) const {
+
+void controller::Rotate(Pose *pose, const std::vector<float> &vec) const {
   Command *command;
-  command = new ScaleCommand(mx, factor);
+  command = new RotateCommand(*pose, vec);
   model_->ExecuteCommand(command);
 }
-void controller::GetOrtho(const float &left, const float &right,
-                          const float &bottom, const float &top,
-                          const float &near, const float &far) const {
+void controller::Translate(Pose *pose, const std::vector<float> &vec) const {
   Command *command;
-  float *result = nullptr;
-  command = new GenOrthoCommand(left, right, bottom, top, near, far, result);
+  command = new TranslateCommand(*pose, vec);
   model_->ExecuteCommand(command);
-  view_->SetResultMatrix(result);
 }
-void controller::GetPerspective(const float &fov, const float &aspect,
-                                const float &near, const float &far) const {
+void controller::Scale(Pose *pose, const float &factor) const {
   Command *command;
-  float *result = nullptr;
-  command = new GenPerspectiveCommand(fov, aspect, near, far, result);
+  command = new ScaleCommand(*pose, factor);
   model_->ExecuteCommand(command);
-  view_->SetResultMatrix(result);
 }
 
 }  // namespace s21
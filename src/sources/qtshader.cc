@@ -67,10 +67,16 @@ std::string QtShader::GetShader(const std::string &filepath) {
   return stream.str();
 }
 
-void QtShader::SetUniVec4Fl(const char *name, const std::vector<float> &vec) {
+void QtShader::SetUniVec4Fl(const char *name,
+                            const std::array<float, 3> &vec) {
   int location = glGetUniformLocation(id_, name);
   glUniform4f(location, vec[0], vec[1], vec[2], 1.0f);
 }
+void QtShader::SetUniVec3Fl(const char *name,
+                            const std::array<float, 3> &vec) {
+  int location = glGetUniformLocation(id_, name);
+  glUniform3f(location, vec[0], vec[1], vec[2]);
+}
 void QtShader::SetUniVariableI(const char *name, const int &value) {
   int location = glGetUniformLocation(id_, name);
   glUniform1i(location, value);
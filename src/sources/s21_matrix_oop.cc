@@ -2,9 +2,198 @@
 
 #include <algorithm>
 #include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../include/AlignedAllocator.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__GNUC__)
+#define S21_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 namespace s21 {
 
+namespace {
+
+// rows and columns of the C tile kept in registers
+constexpr int kTileRows = 6;
+constexpr int kTileCols = 16;
+// depth of the B strips one pass keeps in L1, strips kept in L2
+constexpr int kDepthBlock = 256;
+constexpr int kStripBlock = 32;
+// smallest rows of the operands worth the blocked product
+constexpr int kMinBlocked = 64;
+// rows of C worth another thread
+constexpr int kRowsPerThread = 64;
+
+/**
+ * @struct Panel
+ * @brief one kTileRows x kTileCols tile of C over a range of the depth
+ */
+struct Panel {
+  /// rows of A, missing rows point at zeros
+  const float *a[kTileRows];
+  /// strip of packed B at the first depth of the range
+  const float *b;
+  int depth;
+};
+
+#ifndef __SSE2__
+/**
+ * Sets acc to the A rows times the B strip of a panel
+ */
+void TileScalar(const Panel &panel, float (&acc)[kTileRows][kTileCols]) {
+  for (auto &row : acc) std::fill(std::begin(row), std::end(row), 0.0f);
+  for (int p = 0; p < panel.depth; ++p) {
+    const float *b = panel.b + p * kTileCols;
+    for (int i = 0; i < kTileRows; ++i) {
+      const float a = panel.a[i][p];
+      for (int j = 0; j < kTileCols; ++j) acc[i][j] += a * b[j];
+    }
+  }
+}
+#endif
+
+#ifdef __SSE2__
+void TileSse(const Panel &panel, float (&acc)[kTileRows][kTileCols]) {
+  __m128 sum[kTileRows][kTileCols / 4];
+  for (auto &row : sum) {
+    for (auto &part : row) part = _mm_setzero_ps();
+  }
+  for (int p = 0; p < panel.depth; ++p) {
+    const float *b = panel.b + p * kTileCols;
+    const __m128 b0 = _mm_load_ps(b), b1 = _mm_load_ps(b + 4),
+                 b2 = _mm_load_ps(b + 8), b3 = _mm_load_ps(b + 12);
+    for (int i = 0; i < kTileRows; ++i) {
+      const __m128 a = _mm_set1_ps(panel.a[i][p]);
+      sum[i][0] = _mm_add_ps(sum[i][0], _mm_mul_ps(a, b0));
+      sum[i][1] = _mm_add_ps(sum[i][1], _mm_mul_ps(a, b1));
+      sum[i][2] = _mm_add_ps(sum[i][2], _mm_mul_ps(a, b2));
+      sum[i][3] = _mm_add_ps(sum[i][3], _mm_mul_ps(a, b3));
+    }
+  }
+  for (int i = 0; i < kTileRows; ++i) {
+    for (int j = 0; j < kTileCols / 4; ++j) {
+      _mm_storeu_ps(acc[i] + 4 * j, sum[i][j]);
+    }
+  }
+}
+#endif
+
+#ifdef S21_X86_DISPATCH
+__attribute__((target("avx2,fma"))) void TileAvx2(
+    const Panel &panel, float (&acc)[kTileRows][kTileCols]) {
+  __m256 sum[kTileRows][2];
+  for (auto &row : sum) row[0] = row[1] = _mm256_setzero_ps();
+  for (int p = 0; p < panel.depth; ++p) {
+    const float *b = panel.b + p * kTileCols;
+    const __m256 b0 = _mm256_load_ps(b), b1 = _mm256_load_ps(b + 8);
+    for (int i = 0; i < kTileRows; ++i) {
+      const __m256 a = _mm256_broadcast_ss(panel.a[i] + p);
+      sum[i][0] = _mm256_fmadd_ps(a, b0, sum[i][0]);
+      sum[i][1] = _mm256_fmadd_ps(a, b1, sum[i][1]);
+    }
+  }
+  for (int i = 0; i < kTileRows; ++i) {
+    _mm256_storeu_ps(acc[i], sum[i][0]);
+    _mm256_storeu_ps(acc[i] + 8, sum[i][1]);
+  }
+}
+#endif
+
+using Tile = void (*)(const Panel &, float (&)[kTileRows][kTileCols]);
+
+Tile BestTile() noexcept {
+#ifdef S21_X86_DISPATCH
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return TileAvx2;
+  }
+#endif
+#ifdef __SSE2__
+  return TileSse;
+#else
+  return TileScalar;
+#endif
+}
+
+/**
+ * c += a * b for row-major a (m x k), b (k x n) and c (m x n). B is packed
+ * once into strips of kTileCols columns, zero-padded, so the tile kernel
+ * reads it contiguously. Each thread owns a range of C's rows and walks the
+ * depth in blocks that keep a group of strips in cache while the rows pass
+ * over it
+ */
+void MultiplyBlocked(const float *a, const float *b, float *c, int m, int k,
+                     int n) {
+  const int strips = (n + kTileCols - 1) / kTileCols;
+  // zero-padded past the last column
+  std::vector<float, AlignedAllocator<float>> packed(
+      std::size_t(strips) * k * kTileCols, 0.0f);
+  for (int s = 0; s < strips; ++s) {
+    const int first = s * kTileCols;
+    const int width = std::min(kTileCols, n - first);
+    float *strip = packed.data() + std::size_t(s) * k * kTileCols;
+    for (int p = 0; p < k; ++p) {
+      std::copy_n(b + std::size_t(p) * n + first, width,
+                  strip + std::size_t(p) * kTileCols);
+    }
+  }
+  const std::vector<float> zeros(std::size_t(k), 0.0f);
+  const Tile tile = BestTile();
+
+  auto rows = [&](int begin, int end) {
+    float acc[kTileRows][kTileCols];
+    for (int p0 = 0; p0 < k; p0 += kDepthBlock) {
+      const int depth = std::min(kDepthBlock, k - p0);
+      for (int s0 = 0; s0 < strips; s0 += kStripBlock) {
+        const int s1 = std::min(strips, s0 + kStripBlock);
+        for (int i = begin; i < end; i += kTileRows) {
+          const int height = std::min(kTileRows, end - i);
+          Panel panel{};
+          for (int r = 0; r < kTileRows; ++r) {
+            panel.a[r] = (r < height ? a + std::size_t(i + r) * k
+                                     : zeros.data()) +
+                         p0;
+          }
+          panel.depth = depth;
+          for (int s = s0; s < s1; ++s) {
+            panel.b = packed.data() +
+                      (std::size_t(s) * k + std::size_t(p0)) * kTileCols;
+            tile(panel, acc);
+            const int first = s * kTileCols;
+            const int width = std::min(kTileCols, n - first);
+            for (int r = 0; r < height; ++r) {
+              float *out = c + std::size_t(i + r) * n + first;
+              for (int j = 0; j < width; ++j) out[j] += acc[r][j];
+            }
+          }
+        }
+      }
+    }
+  };
+
+  const int tiles = (m + kTileRows - 1) / kTileRows;
+  const int threads = std::max(
+      1, std::min<int>(int(std::thread::hardware_concurrency()),
+                       m / kRowsPerThread));
+  std::vector<std::thread> workers;
+  auto range = [&](int t) {
+    return std::min(m, tiles * t / threads * kTileRows);
+  };
+  for (int t = 1; t < threads; ++t) {
+    workers.emplace_back(rows, range(t), range(t + 1));
+  }
+  rows(0, range(1));
+  for (auto &worker : workers) worker.join();
+}
+
+}  // namespace
+
 S21Matrix::S21Matrix() : S21Matrix(3, 3) {}
 
 S21Matrix::S21Matrix(const int &rows, const int &cols,
@@ -104,6 +293,12 @@ void S21Matrix::MulMatrix(const S21Matrix &other) {
         "The number of columns of the first matrix is not equal to the number "
         "of rows of the second matrix");
   S21Matrix tmp(rows_, other.cols_);
+  if (std::min({rows_, cols_, other.cols_}) >= kMinBlocked) {
+    MultiplyBlocked(matrix_, other.matrix_, tmp.matrix_, rows_, cols_,
+                    other.cols_);
+    *this = std::move(tmp);
+    return;
+  }
   for (int i = 0, ie = tmp.rows_; i < ie; ++i) {
     for (int j = 0, je = tmp.cols_; j < je; ++j) {
       tmp(i, j) = CalcRowColMul(other, i, j);
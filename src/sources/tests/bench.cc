@@ -0,0 +1,729 @@
+//
+// Created by ruslan on 02.06.23.
+//
+
+/**
+ * @file bench.cc - load path benchmarks on generated meshes, the 4x4
+ * matrix kernels and general matrix products
+ *
+ * Meshes are written once into $TMPDIR/s21_bench and reused by later runs.
+ * Pick sizes with --benchmark_filter, e.g. 'BM_Load/1048576/', and get
+ * machine-readable results with --benchmark_format=json or
+ * --benchmark_out=results.json.
+ */
+
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BlockReader.h"
+#include "MappedFile.h"
+#include "Mat4Expr.h"
+#include "Mat4Kernels.h"
+#include "MeshCache.h"
+#include "Model.h"
+#include "StructuralIndex.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr const char *kMixNames[] = {"tri", "quad", "ngon"};
+constexpr const char *kSyntaxNames[] = {"v", "v/vt", "v//vn", "v/vt/vn"};
+const std::vector<std::int64_t> kFaces = {1 << 10, 1 << 16, 1 << 20, 8 << 20,
+                                          50'000'000};
+const std::vector<std::int64_t> kMixes = {0, 1, 2};
+const std::vector<std::int64_t> kSyntaxes = {0, 1, 2, 3};
+const std::vector<std::int64_t> kTriangles = {0};
+const std::vector<std::int64_t> kPlain = {0};
+constexpr const char *kIsaNames[] = {"scalar", "sse2", "avx2"};
+const std::vector<std::int64_t> kIsas = {0, 1, 2};
+constexpr const char *kReaderNames[] = {"ifstream", "pread", "pread direct",
+                                        "io_uring", "io_uring direct"};
+const std::vector<std::int64_t> kReaders = {0, 1, 2, 3, 4};
+constexpr const char *kFormatNames[] = {"obj", "stl", "ply"};
+const std::vector<std::int64_t> kFormats = {0, 1, 2};
+/// S21Matrix, then Mat4Kernels::Isa + 1
+constexpr const char *kMatrixPathNames[] = {"S21Matrix", "scalar", "sse",
+                                            "avx", "neon"};
+const std::vector<std::int64_t> kMatrixPaths = {0, 1, 2, 3, 4};
+const std::vector<std::int64_t> kKernelPaths = {1, 2, 3, 4};
+const std::vector<std::int64_t> kVectorCounts = {16, 4096, 1 << 20};
+
+/**
+ * @struct Mesh
+ * @brief generated file and what it holds
+ */
+struct Mesh {
+  std::string path;
+  std::size_t bytes = 0;
+  std::size_t faces = 0;
+};
+
+/**
+ * Deterministic coordinates in [-100, 100) with 6 decimals
+ */
+class Random {
+ public:
+  float Next() noexcept {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return float(state_ >> 40) / float(1 << 24) * 200.0f - 100.0f;
+  }
+
+ private:
+  std::uint64_t state_ = 42;
+};
+
+/**
+ * Appends formatted numbers to a buffer that is flushed in large writes
+ */
+class Writer {
+ public:
+  explicit Writer(std::FILE *file) : file_(file) { buffer_.reserve(kSize); }
+
+  ~Writer() { Flush(); }
+
+  Writer &operator<<(const char *str) {
+    buffer_ += str;
+    return *this;
+  }
+
+  Writer &operator<<(std::size_t num) {
+    char digits[24];
+    auto end = std::to_chars(digits, digits + sizeof(digits), num).ptr;
+    buffer_.append(digits, end);
+    return Reserve();
+  }
+
+  Writer &operator<<(float num) {
+    char digits[32];
+    auto end = std::to_chars(digits, digits + sizeof(digits), num,
+                             std::chars_format::fixed, 6)
+                   .ptr;
+    buffer_.append(digits, end);
+    return Reserve();
+  }
+
+ private:
+  Writer &Reserve() {
+    if (buffer_.size() > kSize - 256) Flush();
+    return *this;
+  }
+
+  void Flush() {
+    std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    buffer_.clear();
+  }
+
+  static constexpr std::size_t kSize = 1 << 20;
+
+  std::FILE *file_;
+  std::string buffer_;
+};
+
+/**
+ * Polygon size of face i: triangles, quads or 3 to 8 sided polygons
+ */
+std::size_t Sides(std::size_t mix, std::size_t i) noexcept {
+  return mix == 0 ? 3 : mix == 1 ? 4 : 3 + i % 6;
+}
+
+/**
+ * Writes a mesh of neighbouring polygons over a cloud of vertices, about
+ * one vertex per two faces like a closed triangle mesh
+ */
+Mesh Generate(std::size_t faces, std::size_t mix, std::size_t syntax) {
+  auto dir = fs::temp_directory_path() / "s21_bench";
+  fs::create_directories(dir);
+  Mesh mesh;
+  mesh.faces = faces;
+  mesh.path = (dir / (std::to_string(faces) + "_" + kMixNames[mix] + "_" +
+                      std::to_string(syntax) + ".obj"))
+                  .string();
+  if (!fs::exists(mesh.path)) {
+    auto temp = mesh.path + ".tmp";
+    std::FILE *file = std::fopen(temp.c_str(), "wb");
+    if (!file) throw std::runtime_error("Failed to create " + temp);
+    {
+      Writer out(file);
+      Random random;
+      const std::size_t vertexes = faces / 2 + 16;
+      for (std::size_t i = 0; i < vertexes; ++i) {
+        out << "v " << random.Next() << " " << random.Next() << " "
+            << random.Next() << "\n";
+      }
+      if (syntax == 1 || syntax == 3) {
+        for (std::size_t i = 0; i < vertexes; ++i) {
+          out << "vt " << random.Next() << " " << random.Next() << "\n";
+        }
+      }
+      if (syntax >= 2) {
+        for (std::size_t i = 0; i < vertexes; ++i) {
+          out << "vn " << random.Next() << " " << random.Next() << " "
+              << random.Next() << "\n";
+        }
+      }
+      const char *separator = syntax == 2 ? "//" : "/";
+      for (std::size_t i = 0; i < faces; ++i) {
+        out << "f";
+        std::size_t base = i / 2 % (vertexes - 8) + 1;
+        for (std::size_t j = 0, sides = Sides(mix, i); j < sides; ++j) {
+          out << " " << base + j;
+          if (syntax == 1 || syntax == 2) out << separator << base + j;
+          if (syntax == 3) out << "/" << base + j << "/" << base + j;
+        }
+        out << "\n";
+      }
+    }
+    std::fclose(file);
+    fs::rename(temp, mesh.path);
+  }
+  mesh.bytes = fs::file_size(mesh.path);
+  return mesh;
+}
+
+void SetCounters(benchmark::State &state, const Mesh &mesh) {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  state.SetBytesProcessed(std::int64_t(mesh.bytes) * state.iterations());
+  state.counters["faces/s"] =
+      benchmark::Counter(double(mesh.faces) * double(state.iterations()),
+                         benchmark::Counter::kIsRate);
+  // the process peak, run one size per process for per-size figures
+  state.counters["peak_rss_MiB"] = double(usage.ru_maxrss) / 1024;
+}
+
+/**
+ * Adds the stage times of one load to a sum over the iterations
+ */
+void AddTimings(s21::LoadTimings &sum, const s21::LoadTimings &timings) {
+  sum.read += timings.read;
+  sum.parse += timings.parse;
+  sum.stall += timings.stall;
+  sum.resolve += timings.resolve;
+  sum.dedup += timings.dedup;
+  sum.bounds += timings.bounds;
+  sum.pack += timings.pack;
+}
+
+/**
+ * Reports the milliseconds per load of each stage, stages that took no time,
+ * like stall on a mapped file, are left out
+ */
+void SetStageCounters(benchmark::State &state, const s21::LoadTimings &sum) {
+  const std::pair<const char *, double> stages[] = {
+      {"read_ms", sum.read},       {"parse_ms", sum.parse},
+      {"stall_ms", sum.stall},     {"resolve_ms", sum.resolve},
+      {"dedup_ms", sum.dedup},     {"bounds_ms", sum.bounds},
+      {"pack_ms", sum.pack}};
+  for (const auto &[name, seconds] : stages) {
+    if (seconds > 0) {
+      state.counters[name] = benchmark::Counter(
+          seconds * 1000, benchmark::Counter::kAvgIterations);
+    }
+  }
+}
+
+s21::Obj Load(const Mesh &mesh, const s21::LoadOptions &options) {
+  s21::Obj result;
+  s21::Model::ExecuteCommand(
+      new s21::OpenFileCommand(mesh.path, result, options));
+  return result;
+}
+
+Mesh MeshOf(const benchmark::State &state) {
+  return Generate(std::size_t(state.range(0)), std::size_t(state.range(1)),
+                  std::size_t(state.range(2)));
+}
+
+void Label(benchmark::State &state) {
+  state.SetLabel(std::string(kMixNames[state.range(1)]) + " " +
+                 kSyntaxNames[state.range(2)]);
+}
+
+/**
+ * Reading the file without parsing, the ceiling for the other stages
+ */
+void BM_Read(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  for (auto _ : state) {
+    s21::MappedFile file;
+    file.Map(mesh.path);
+    std::size_t lines = 0;
+    for (const char *pos = file.begin(); pos != file.end(); ++pos) {
+      lines += *pos == '\n';
+    }
+    benchmark::DoNotOptimize(lines);
+  }
+  SetCounters(state, mesh);
+  Label(state);
+}
+
+/**
+ * Drops the file from the page cache, so the next read comes from the disk
+ */
+void Evict(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+/**
+ * Cold-cache reads with each backend of the loader, ifstream for comparison.
+ * Rates are per wall-clock second, the reads spend their time waiting
+ */
+void BM_ReadCold(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  const auto reader_kind = std::size_t(state.range(3));
+  using Backend = s21::BlockReader::Backend;
+  const auto backend = reader_kind >= 3 ? Backend::kIoUring : Backend::kPread;
+  if (reader_kind && !s21::BlockReader::Supported(backend)) {
+    state.SkipWithError("not supported by this kernel");
+    return;
+  }
+  std::vector<char> buffer(4 << 20);
+  for (auto _ : state) {
+    state.PauseTiming();
+    Evict(mesh.path);
+    state.ResumeTiming();
+    std::size_t bytes = 0;
+    if (!reader_kind) {
+      std::ifstream in(mesh.path, std::ios::binary);
+      while (in.read(buffer.data(), std::streamsize(buffer.size())) ||
+             in.gcount()) {
+        bytes += std::size_t(in.gcount());
+      }
+    } else {
+      s21::BlockReader reader;
+      reader.Open(mesh.path, backend, reader_kind % 2 == 0);
+      while (auto size = reader.Read(buffer.data(), buffer.size())) {
+        bytes += size;
+      }
+    }
+    benchmark::DoNotOptimize(bytes);
+  }
+  SetCounters(state, mesh);
+  state.SetLabel(kReaderNames[reader_kind]);
+}
+
+/**
+ * Building the structural index of each block alone, with every instruction
+ * set the CPU supports
+ */
+void BM_Index(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  auto isa = s21::StructuralIndex::Isa(state.range(3));
+  if (!s21::StructuralIndex::Supported(isa)) {
+    state.SkipWithError("not supported by this CPU");
+    return;
+  }
+  s21::MappedFile file;
+  file.Map(mesh.path);
+  s21::StructuralIndex index;
+  for (auto _ : state) {
+    std::size_t entries = 0;
+    for (const char *pos = file.begin(); pos != file.end();) {
+      const char *last = file.end();
+      if (std::size_t(last - pos) > s21::StructuralIndex::kMaxBlock) {
+        last = pos + s21::StructuralIndex::kMaxBlock;
+        while (last != pos && last[-1] != '\n') --last;
+      }
+      index.Build(pos, std::size_t(last - pos), isa);
+      entries += index.size();
+      pos = last;
+    }
+    benchmark::DoNotOptimize(entries);
+  }
+  SetCounters(state, mesh);
+  state.SetLabel(std::string(kSyntaxNames[state.range(2)]) + " " +
+                 kIsaNames[state.range(3)]);
+}
+
+/**
+ * Writes the triangles of a generated OBJ as binary STL or little-endian PLY
+ * next to it
+ * @param format - 1 for STL, 2 for PLY
+ */
+Mesh Convert(const Mesh &mesh, std::size_t format) {
+  Mesh converted = mesh;
+  converted.path = fs::path(mesh.path)
+                       .replace_extension(kFormatNames[format])
+                       .string();
+  if (!fs::exists(converted.path)) {
+    s21::Obj obj = Load(mesh, {});
+    const auto &vertexes = *obj.vertexes;
+    const auto &facetes = *obj.facetes;
+    const std::size_t triangles = facetes.size() / 6;
+    std::vector<char> data;
+    auto append = [&data](const auto &value) {
+      const auto *bytes = reinterpret_cast<const char *>(&value);
+      data.insert(data.end(), bytes, bytes + sizeof(value));
+    };
+    if (format == 1) {
+      data.resize(80);
+      append(std::uint32_t(triangles));
+      for (std::size_t i = 0; i < triangles; ++i) {
+        data.resize(data.size() + 12);
+        for (std::size_t corner = 0; corner < 3; ++corner) {
+          for (std::size_t axis = 0; axis < 3; ++axis) {
+            append(vertexes[3 * facetes[6 * i + 2 * corner] + axis]);
+          }
+        }
+        append(std::uint16_t(0));
+      }
+    } else {
+      std::string header =
+          "ply\nformat binary_little_endian 1.0\nelement vertex " +
+          std::to_string(vertexes.size() / 3) +
+          "\nproperty float x\nproperty float y\nproperty float z\n"
+          "element face " +
+          std::to_string(triangles) +
+          "\nproperty list uchar int vertex_indices\nend_header\n";
+      data.assign(header.begin(), header.end());
+      for (float coordinate : vertexes) append(coordinate);
+      for (std::size_t i = 0; i < triangles; ++i) {
+        append(std::uint8_t(3));
+        for (std::size_t corner = 0; corner < 3; ++corner) {
+          append(std::int32_t(facetes[6 * i + 2 * corner]));
+        }
+      }
+    }
+    auto temp = converted.path + ".tmp";
+    std::ofstream(temp, std::ios::binary)
+        .write(data.data(), std::streamsize(data.size()));
+    fs::rename(temp, converted.path);
+  }
+  converted.bytes = fs::file_size(converted.path);
+  return converted;
+}
+
+/**
+ * Parsing alone, as OpenFileCommand does by default
+ */
+void BM_Load(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  s21::LoadTimings timings;
+  for (auto _ : state) {
+    auto result = Load(mesh, {});
+    benchmark::DoNotOptimize(result.vertexes.get());
+    AddTimings(timings, result.timings);
+  }
+  SetCounters(state, mesh);
+  SetStageCounters(state, timings);
+  Label(state);
+}
+
+/**
+ * Parsing with the post-processing the viewer asks for
+ */
+void BM_LoadViewer(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  s21::LoadOptions options;
+  options.weld = true;
+  options.unique_edges = true;
+  options.pack_indexes = true;
+  s21::LoadTimings timings;
+  for (auto _ : state) {
+    auto result = Load(mesh, options);
+    benchmark::DoNotOptimize(result.vertexes.get());
+    AddTimings(timings, result.timings);
+  }
+  SetCounters(state, mesh);
+  SetStageCounters(state, timings);
+  Label(state);
+}
+
+/**
+ * The same triangles loaded from OBJ text, binary STL (welded on load) and
+ * binary PLY
+ */
+void BM_LoadFormat(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  if (state.range(3)) mesh = Convert(mesh, std::size_t(state.range(3)));
+  s21::LoadTimings timings;
+  for (auto _ : state) {
+    auto result = Load(mesh, {});
+    benchmark::DoNotOptimize(result.vertexes.get());
+    AddTimings(timings, result.timings);
+  }
+  SetCounters(state, mesh);
+  SetStageCounters(state, timings);
+  state.SetLabel(kFormatNames[state.range(3)]);
+}
+
+void BM_Weld(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  s21::LoadOptions options;
+  options.weld = true;
+  for (auto _ : state) {
+    auto result = Load(mesh, options);
+    benchmark::DoNotOptimize(result.vertexes.get());
+  }
+  SetCounters(state, mesh);
+  Label(state);
+}
+
+void BM_UniqueEdges(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  s21::LoadOptions options;
+  options.unique_edges = true;
+  for (auto _ : state) {
+    auto result = Load(mesh, options);
+    benchmark::DoNotOptimize(result.vertexes.get());
+  }
+  SetCounters(state, mesh);
+  Label(state);
+}
+
+void BM_Pack(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  auto result = Load(mesh, {});
+  for (auto _ : state) {
+    auto packed =
+        s21::IndexBuffer::Pack(*result.facetes, result.vertexes->size() / 3);
+    benchmark::DoNotOptimize(packed.data.data());
+  }
+  SetCounters(state, mesh);
+  Label(state);
+}
+
+void BM_Quantize(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  auto result = Load(mesh, {});
+  for (auto _ : state) {
+    auto quantized = s21::QuantizedVertexes::Quantize(
+        *result.vertexes, result.bounds.lower, result.bounds.upper);
+    benchmark::DoNotOptimize(quantized.data.data());
+  }
+  SetCounters(state, mesh);
+  Label(state);
+}
+
+/**
+ * Reopening from the binary cache instead of parsing
+ */
+void BM_CacheLoad(benchmark::State &state) {
+  auto mesh = MeshOf(state);
+  auto dir = (fs::temp_directory_path() / "s21_bench" / "cache").string();
+  s21::LoadOptions options;
+  options.use_cache = true;
+  options.cache_dir = dir;
+  Load(mesh, options);
+  for (auto _ : state) {
+    auto result = Load(mesh, options);
+    benchmark::DoNotOptimize(result.vertexes.get());
+  }
+  SetCounters(state, mesh);
+  Label(state);
+}
+
+/**
+ * @return the instruction set of a matrix benchmark, skips it if the build
+ * or the CPU doesn't support it
+ */
+bool MatrixIsa(benchmark::State &state, s21::Mat4Kernels::Isa &isa) {
+  state.SetLabel(kMatrixPathNames[state.range(0)]);
+  isa = s21::Mat4Kernels::Isa(state.range(0) - 1);
+  if (s21::Mat4Kernels::Supported(isa)) return true;
+  state.SkipWithError("not supported here");
+  return false;
+}
+
+/**
+ * One 4x4 product, through S21Matrix as the transform commands used to and
+ * through each kernel
+ */
+void BM_Mat4Multiply(benchmark::State &state) {
+  float values[16];
+  for (int i = 0; i < 16; ++i) values[i] = float(i % 5) * 0.25f - 0.5f;
+  if (state.range(0) == 0) {
+    state.SetLabel(kMatrixPathNames[0]);
+    auto a = s21::S21Matrix::Init4x4fv(values);
+    auto b = s21::S21Matrix::Init4x4fv(values);
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(a);
+      auto product = a * b;
+      benchmark::DoNotOptimize(product.GetPointer());
+    }
+    return;
+  }
+  s21::Mat4Kernels::Isa isa;
+  if (!MatrixIsa(state, isa)) return;
+  auto a = s21::Mat4::FromArray(values), b = a;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    auto product = s21::Mat4Kernels::Multiply(a, b, isa);
+    benchmark::DoNotOptimize(product);
+  }
+}
+
+/**
+ * paintGL's projection^T * view^T * model, one product at a time through
+ * S21Matrix as it used to be and through each kernel
+ */
+void BM_MvpChain(benchmark::State &state) {
+  const auto projection = s21::Mat4::Perspective(1.0f, 0.75f, 1, 100);
+  const auto view = s21::Mat4::Translate(0, 0, -1);
+  const auto model = s21::Mat4::Scale(0.5f);
+  if (state.range(0) == 0) {
+    state.SetLabel(kMatrixPathNames[0]);
+    auto p = projection.ToMatrix(), v = view.ToMatrix(), m = model.ToMatrix();
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(p);
+      auto mvp = p.Transpose() * v.Transpose() * m;
+      benchmark::DoNotOptimize(mvp.GetPointer());
+    }
+    return;
+  }
+  s21::Mat4Kernels::Isa isa;
+  if (!MatrixIsa(state, isa)) return;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(projection);
+    auto mvp = s21::Mat4Kernels::Multiply(
+        s21::Mat4Kernels::Multiply(s21::Mat4Kernels::Transpose(projection, isa),
+                                   s21::Mat4Kernels::Transpose(view, isa),
+                                   isa),
+        model, isa);
+    benchmark::DoNotOptimize(mvp);
+  }
+}
+
+/**
+ * The same MVP as one fused expression
+ */
+void BM_MvpFused(benchmark::State &state) {
+  s21::Mat4Kernels::Isa isa;
+  if (!MatrixIsa(state, isa)) return;
+  const auto projection = s21::Mat4::Perspective(1.0f, 0.75f, 1, 100);
+  const auto view = s21::Mat4::Translate(0, 0, -1);
+  const auto model = s21::Mat4::Scale(0.5f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(projection);
+    auto mvp = s21::Evaluate(s21::Lazy(projection).Transpose() *
+                                 s21::Lazy(view).Transpose() *
+                                 s21::Lazy(model),
+                             isa);
+    benchmark::DoNotOptimize(mvp);
+  }
+}
+
+/**
+ * One mouse-drag step through RotateCommand, two angles as mouseMoveEvent
+ * passes them, and the per-frame model matrix
+ */
+void BM_Rotate(benchmark::State &state) {
+  s21::Pose pose;
+  const std::vector<float> angles{1e-4f, -2e-4f, 0.0f};
+  for (auto _ : state) {
+    s21::RotateCommand(pose, angles).execute();
+    benchmark::DoNotOptimize(pose);
+  }
+}
+
+void BM_PoseToMat4(benchmark::State &state) {
+  s21::Pose pose;
+  pose.Rotate(0.3f, -0.2f, 0.1f);
+  pose.Scale(1.5f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pose);
+    auto model = pose.ToMat4();
+    benchmark::DoNotOptimize(model);
+  }
+}
+
+void BM_Mat4Transform(benchmark::State &state) {
+  s21::Mat4Kernels::Isa isa;
+  if (!MatrixIsa(state, isa)) return;
+  const auto count = std::size_t(state.range(1));
+  std::vector<s21::Vec4> points(count, s21::Vec4{{1, 2, 3, 1}});
+  auto m = s21::Mat4::Translate(0.5f, -0.25f, 1) * s21::Mat4::Scale(0.999f);
+  for (auto _ : state) {
+    s21::Mat4Kernels::Transform(m, points.data(), points.data(), count, isa);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(std::int64_t(count) * state.iterations());
+}
+
+/**
+ * Square S21Matrix products, small ones through the plain loop and larger
+ * ones through the blocked, multi-threaded path
+ */
+void BM_MatrixMultiply(benchmark::State &state) {
+  const auto size = int(state.range(0));
+  s21::S21Matrix a(size, size), b(size, size);
+  for (int i = 0; i < size; ++i) {
+    for (int j = 0; j < size; ++j) {
+      a(i, j) = float((i + 2 * j) % 9) * 0.125f;
+      b(i, j) = float((3 * i + j) % 7) * 0.25f;
+    }
+  }
+  for (auto _ : state) {
+    auto product = a * b;
+    benchmark::DoNotOptimize(product.GetPointer());
+  }
+  state.counters["GFLOP"] = benchmark::Counter(
+      2.0 * size * size * size * double(state.iterations()) / 1e9,
+      benchmark::Counter::kIsRate);
+}
+
+}  // namespace
+
+BENCHMARK(BM_MatrixMultiply)
+    ->RangeMultiplier(4)
+    ->Range(4, 4096)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Mat4Multiply)->ArgsProduct({kMatrixPaths});
+BENCHMARK(BM_MvpChain)->ArgsProduct({kMatrixPaths});
+BENCHMARK(BM_MvpFused)->ArgsProduct({kKernelPaths});
+BENCHMARK(BM_Rotate);
+BENCHMARK(BM_PoseToMat4);
+BENCHMARK(BM_Mat4Transform)->ArgsProduct({kKernelPaths, kVectorCounts});
+BENCHMARK(BM_Read)
+    ->ArgsProduct({kFaces, kTriangles, kPlain})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ReadCold)
+    ->ArgsProduct({kFaces, kTriangles, kPlain, kReaders})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Index)
+    ->ArgsProduct({kFaces, kTriangles, kSyntaxes, kIsas})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Load)
+    ->ArgsProduct({kFaces, kMixes, kSyntaxes})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadViewer)
+    ->ArgsProduct({kFaces, kMixes, kPlain})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadFormat)
+    ->ArgsProduct({kFaces, kTriangles, kPlain, kFormats})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Weld)
+    ->ArgsProduct({kFaces, kTriangles, kPlain})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_UniqueEdges)
+    ->ArgsProduct({kFaces, kTriangles, kPlain})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Pack)
+    ->ArgsProduct({kFaces, kTriangles, kPlain})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Quantize)
+    ->ArgsProduct({kFaces, kTriangles, kPlain})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CacheLoad)
+    ->ArgsProduct({kFaces, kTriangles, kPlain})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -1,6 +1,41 @@
 #include "test.h"
 
+#include <zlib.h>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+
+#include "BlockReader.h"
+#include "Camera.h"
+#include "Mat4Expr.h"
+#include "Mat4Kernels.h"
+#include "MeshCache.h"
+#include "MeshLoader.h"
 #include "Model.h"
+#include "StructuralIndex.h"
+
+namespace {
+/// calls of the global operator new, which this file replaces
+std::atomic<std::size_t> allocations{0};
+}  // namespace
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = std::malloc(size ? size : 1)) return memory;
+  throw std::bad_alloc();
+}
+// out of line, or GCC sees free() meet new and warns
+__attribute__((noinline)) void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+__attribute__((noinline)) void operator delete(void *memory,
+                                               std::size_t) noexcept {
+  std::free(memory);
+}
 
 namespace {
 TEST_F(ModelTest, open_test_0) {
@@ -8,10 +43,10 @@ TEST_F(ModelTest, open_test_0) {
   s21::Command *command =
       new s21::OpenFileCommand("./sources/tests/correct_sample.txt", result);
   model_.ExecuteCommand(command);
-  std::vector<float> expected_v{
+  s21::vertex expected_v{
       1, 1, 0, 1, 0, 1, 123.123, 456.321, -342.85, 87.32, -75.45, 12.32};
-  std::vector<unsigned> expected_f{1, 2, 2, 3, 3, 1, 3, 4, 4, 1,
-                                   1, 2, 2, 3, 1, 3, 3, 2, 2, 1};
+  s21::facet expected_f{1, 2, 2, 3, 3, 1, 3, 4, 4, 1,
+                        1, 2, 2, 3, 1, 3, 3, 2, 2, 1};
 
   EXPECT_FALSE(result.vertexes->empty());
   EXPECT_FALSE(result.facetes->empty());
@@ -25,6 +60,766 @@ TEST_F(ModelTest, open_test_0) {
   }
 }
 
+TEST_F(ModelTest, open_test_forward) {
+  s21::Obj result;
+  s21::Command *command =
+      new s21::OpenFileCommand("./sources/tests/forward_sample.txt", result);
+  model_.ExecuteCommand(command);
+  s21::facet expected_f{0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2,
+                        0, 3, 2, 2, 1, 1, 0, 0, 3};
+
+  EXPECT_EQ(result.vertexes->size(), 12u);
+  EXPECT_EQ(*result.facetes, expected_f);
+}
+
+TEST_F(ModelTest, open_test_mmap) {
+  s21::Obj mapped, buffered;
+  s21::LoadOptions options;
+  options.mmap_threshold = 0;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", mapped, options));
+  options.use_mmap = false;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", buffered, options));
+
+  EXPECT_EQ(*mapped.vertexes, *buffered.vertexes);
+  EXPECT_EQ(*mapped.facetes, *buffered.facetes);
+  EXPECT_EQ(mapped.min, buffered.min);
+  EXPECT_EQ(mapped.max, buffered.max);
+  // mapped files are counted before parsing, the arrays never grow
+  EXPECT_EQ(mapped.vertexes->capacity(), mapped.vertexes->size());
+  EXPECT_GE(mapped.facetes->capacity(), mapped.facetes->size());
+  EXPECT_LE(mapped.facetes->capacity(), mapped.facetes->size() * 17 / 16);
+  auto *data = mapped.vertexes->data();
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(data) % 64, 0u);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(mapped.facetes->data()) % 64, 0u);
+  s21::Obj moved = std::move(mapped);
+  EXPECT_EQ(moved.vertexes->data(), data);
+  EXPECT_EQ(mapped.vertexes, nullptr);
+}
+
+TEST_F(ModelTest, structural_index_test) {
+  std::string text = "v 1 2 3\n  f 1/2/3\t4//5 +6 \r\nvn\n\n g  name\t\n";
+  text += std::string(100, 'x') + " \v\fy";
+  auto separator = [](char c) { return c == ' ' || (c >= '\t' && c <= '\r'); };
+  std::vector<std::uint16_t> expected;
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    bool start = !separator(text[i]) && (!i || separator(text[i - 1]));
+    if (start || text[i] == '\n') expected.push_back(std::uint16_t(i));
+  }
+  using Isa = s21::StructuralIndex::Isa;
+  s21::StructuralIndex index;
+  for (auto isa : {Isa::kScalar, Isa::kSse2, Isa::kAvx2}) {
+    if (!s21::StructuralIndex::Supported(isa)) continue;
+    index.Build(text.data(), text.size(), isa);
+    EXPECT_EQ(std::vector<std::uint16_t>(index.begin(), index.end()),
+              expected);
+  }
+  std::string block(s21::StructuralIndex::kMaxBlock + 1, 'x');
+  index.Build(block.data(), block.size() - 1);
+  EXPECT_EQ(index.size(), 1u);
+  EXPECT_THROW(index.Build(block.data(), block.size()), std::runtime_error);
+}
+
+TEST_F(ModelTest, block_reader_test) {
+  namespace fs = std::filesystem;
+  auto file = (fs::temp_directory_path() / "s21_blocks.bin").string();
+  std::string data(5 * s21::BlockReader::kBufferSize + 12345, '\0');
+  for (std::size_t i = 0; i < data.size(); ++i) data[i] = char(i * 7 % 251);
+  std::ofstream(file, std::ios::binary).write(data.data(),
+                                              std::streamsize(data.size()));
+  using Backend = s21::BlockReader::Backend;
+  s21::BlockReader reader;
+  for (auto backend : {Backend::kPread, Backend::kIoUring}) {
+    if (!s21::BlockReader::Supported(backend)) continue;
+    for (bool direct : {false, true}) {
+      // smaller and larger than a buffer
+      for (std::size_t piece_size : {(1 << 20) + 7, 3 << 20}) {
+        ASSERT_TRUE(reader.Open(file, backend, direct));
+        EXPECT_EQ(reader.size(), data.size());
+        std::string read;
+        std::vector<char> piece(piece_size);
+        while (auto size = reader.Read(piece.data(), piece.size())) {
+          read.append(piece.data(), size);
+        }
+        EXPECT_EQ(read == data, true);
+        EXPECT_EQ(reader.Consumed(), data.size());
+        EXPECT_EQ(reader.Read(piece.data(), piece.size()), 0u);
+      }
+    }
+  }
+  EXPECT_FALSE(reader.Open(fs::temp_directory_path().string()));
+  fs::remove(file);
+}
+
+TEST_F(ModelTest, open_test_tokens) {
+  namespace fs = std::filesystem;
+  auto file = (fs::temp_directory_path() / "s21_tokens.obj").string();
+  {
+    std::ofstream out(file);
+    // many blocks of the index
+    for (int i = 0; i < 20000; ++i) {
+      out << "v " << i << " " << i << ".5 -" << i << "\n";
+    }
+    out << "v 1-2 3\r\n";
+    out << "  v 7 7 7\nv\t1 1 1\n";
+    out << "f 1/2/3\t2//5 +3 \r\n";
+    out << "f 1 2 " << std::string(70000, ' ') << "4\n";
+    out << "f 4 5";
+  }
+  s21::Obj result;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, result));
+  ASSERT_EQ(result.vertexes->size(), 20001u * 3);
+  EXPECT_EQ((*result.vertexes)[3 * 5 + 1], 5.5f);
+  EXPECT_EQ((*result.vertexes)[3 * 19999 + 2], -19999.0f);
+  s21::vertex last(result.vertexes->end() - 3, result.vertexes->end());
+  EXPECT_EQ(last, (s21::vertex{1, -2, 3}));
+  EXPECT_EQ(*result.facetes, (s21::facet{0, 1, 1, 2, 2, 0, 0, 1, 1, 3, 3, 0}));
+  fs::remove(file);
+}
+
+TEST_F(ModelTest, open_test_face_syntaxes) {
+  namespace fs = std::filesystem;
+  auto file = (fs::temp_directory_path() / "s21_syntaxes.obj").string();
+  {
+    std::ofstream out(file);
+    out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+    // lines longer than an index block are parsed one char at a time
+    std::string pad(70000, ' ');
+    for (const char *face :
+         {"1/1 2/2 3/3", "2/2 3/3 4/4", "-1/1/1 -2/2/2 -3/3/3",
+          "1/1/1 2/2/2 3/3/3 4/4/4", "1//1 2/2 3", "1//1 -1//2 3//3",
+          "0000000001 2 3", "1 2 3", "1 2 3x 4"}) {
+      out << "f " << face << pad << "\n";
+    }
+  }
+  s21::Obj result;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, result));
+  EXPECT_EQ(*result.facetes,
+            (s21::facet{0, 1, 1, 2, 2, 0, 1, 2, 2, 3, 3, 1, 3, 2, 2, 1, 1, 3,
+                        0, 1, 1, 2, 2, 3, 3, 0, 0, 1, 1, 2, 2, 0, 0, 3, 3, 2,
+                        2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2,
+                        2, 3, 3, 0}));
+
+  // runs of one syntax, each through its own parser after the first face,
+  // from the structural index as well as one char at a time
+  for (std::size_t pad : {std::size_t(0), std::size_t(70000)}) {
+    {
+      std::ofstream out(file);
+      out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+      for (const char *face :
+           {"1 2 3 4", "1/1 2/2 3/3 4/4", "1//1 2//2 3//3 4//4",
+            "1/1/1 2/2/2 3/3/3 -1/4/4"}) {
+        for (int i = 0; i < 1000; ++i) {
+          out << "f " << face << std::string(i ? 0 : pad, ' ') << "\n";
+        }
+      }
+    }
+    s21::Obj runs;
+    s21::LoadOptions options;
+    options.threads = 1;
+    model_.ExecuteCommand(new s21::OpenFileCommand(file, runs, options));
+    EXPECT_EQ(runs.generic_faces, 4u);
+    ASSERT_EQ(runs.facetes->size(), 4000u * 8);
+    EXPECT_EQ(s21::facet(runs.facetes->end() - 8, runs.facetes->end()),
+              (s21::facet{0, 1, 1, 2, 2, 3, 3, 0}));
+  }
+  fs::remove(file);
+}
+
+TEST_F(ModelTest, open_test_timings) {
+  for (std::size_t threshold : {std::size_t(1), std::size_t(1) << 30}) {
+    s21::Obj result;
+    s21::LoadOptions options;
+    options.mmap_threshold = threshold;
+    options.pack_indexes = true;
+    model_.ExecuteCommand(
+        new s21::OpenFileCommand("./objects/skull.obj", result, options));
+    const auto &timings = result.timings;
+    EXPECT_GT(timings.read, 0);
+    EXPECT_GT(timings.parse, 0);
+    EXPECT_GT(timings.total, timings.parse);
+    EXPECT_GE(timings.total, timings.resolve + timings.bounds + timings.pack);
+    EXPECT_EQ(timings.upload, 0);
+  }
+}
+
+TEST_F(ModelTest, open_test_threads) {
+  s21::Obj serial, parallel;
+  s21::LoadOptions options;
+  options.threads = 1;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", serial, options));
+  options.threads = 7;
+  options.chunk_size = 4096;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", parallel, options));
+
+  EXPECT_EQ(*serial.vertexes, *parallel.vertexes);
+  EXPECT_EQ(*serial.facetes, *parallel.facetes);
+  EXPECT_EQ(serial.min, parallel.min);
+  EXPECT_EQ(serial.max, parallel.max);
+  EXPECT_EQ((*serial.facetes)[0], 3441u - 745u);
+}
+
+TEST_F(ModelTest, open_test_progress) {
+  s21::Obj result;
+  s21::LoadOptions options;
+  std::size_t done = 0, total = 0;
+  options.progress = [&](std::size_t d, std::size_t t) { done = d, total = t; };
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", result, options));
+
+  EXPECT_EQ(done, 730653u);
+  EXPECT_EQ(total, 730653u);
+}
+
+TEST_F(ModelTest, open_test_cancel) {
+  s21::Obj result;
+  s21::LoadOptions options;
+  std::atomic<bool> cancel{true};
+  options.cancel = &cancel;
+  s21::Command *command =
+      new s21::OpenFileCommand("./objects/skull.obj", result, options);
+  EXPECT_THROW(model_.ExecuteCommand(command), std::runtime_error);
+  EXPECT_EQ(result.vertexes, nullptr);
+  EXPECT_EQ(result.facetes, nullptr);
+}
+
+TEST_F(ModelTest, cache_test) {
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() / "s21_cache_test";
+  fs::remove_all(dir);
+  for (bool compress : {false, true}) {
+    s21::Obj parsed, cached;
+    s21::LoadOptions options;
+    options.use_cache = true;
+    options.cache_dir = dir.string();
+    options.cache_compress = compress;
+    model_.ExecuteCommand(
+        new s21::OpenFileCommand("./objects/skull.obj", parsed, options));
+    ASSERT_FALSE(fs::is_empty(dir));
+    s21::MeshCache cache(dir.string(), options.cache_limit, compress);
+    ASSERT_TRUE(cache.Load("./objects/skull.obj", cached));
+
+    EXPECT_EQ(*parsed.vertexes, *cached.vertexes);
+    EXPECT_EQ(*parsed.facetes, *cached.facetes);
+    EXPECT_EQ(parsed.min, cached.min);
+    EXPECT_EQ(parsed.max, cached.max);
+    EXPECT_EQ(parsed.bounds.lower, cached.bounds.lower);
+    EXPECT_EQ(parsed.bounds.upper, cached.bounds.upper);
+  }
+  fs::remove_all(dir);
+}
+
+TEST_F(ModelTest, cache_test_stale) {
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() / "s21_cache_stale_test";
+  auto file = (dir / "model.obj").string();
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::ofstream(file) << "v 1 2 3\nv 4 5 6\nv 7 8 9\nf 1 2 3\n";
+  s21::Obj stored;
+  stored.vertexes =
+      std::make_unique<s21::vertex>(s21::vertex{1, 2, 3, 4, 5, 6, 7, 8, 9});
+  stored.facetes = std::make_unique<s21::facet>(s21::facet{0, 1, 1, 2, 2, 0});
+  s21::MeshCache(dir.string(), 1 << 20, false).Store(file, stored);
+
+  s21::Obj result;
+  EXPECT_TRUE(s21::MeshCache(dir.string(), 1 << 20, false).Load(file, result));
+
+  std::ofstream(file) << "v 1 2 3\nv 4 5 6\nv 7 8 0\nf 1 2 3\n";
+  result = s21::Obj{};
+  EXPECT_FALSE(
+      s21::MeshCache(dir.string(), 1 << 20, false).Load(file, result));
+  EXPECT_EQ(result.vertexes, nullptr);
+
+  s21::MeshCache(dir.string(), 0, false).Store(file, stored);
+  for (auto &entry : fs::directory_iterator(dir)) {
+    EXPECT_NE(entry.path().extension(), ".mesh");
+  }
+  fs::remove_all(dir);
+}
+
+TEST_F(ModelTest, cache_test_corrupt) {
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() / "s21_cache_corrupt_test";
+  auto file = (dir / "model.obj").string();
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::ofstream(file) << "v 1 2 3\nv 4 5 6\nv 7 8 9\nf 1 2 3\n";
+  s21::Obj stored;
+  stored.vertexes =
+      std::make_unique<s21::vertex>(s21::vertex{1, 2, 3, 4, 5, 6, 7, 8, 9});
+  stored.facetes = std::make_unique<s21::facet>(s21::facet{0, 1, 1, 2, 2, 0});
+  using Header = s21::MeshCache::Header;
+  // counts no payload can hold, allocating them would throw
+  const std::pair<std::size_t, std::uint64_t> fields[] = {
+      {offsetof(Header, vertex_count), std::uint64_t(3) << 60},
+      {offsetof(Header, index_count), std::uint64_t(1) << 62},
+      {offsetof(Header, group_bytes), ~std::uint64_t(0)}};
+  for (bool compress : {false, true}) {
+    for (auto [offset, count] : fields) {
+      s21::MeshCache(dir.string(), 1 << 20, compress).Store(file, stored);
+      for (auto &entry : fs::directory_iterator(dir)) {
+        if (entry.path().extension() != ".mesh") continue;
+        std::fstream out(entry.path(),
+                         std::ios::in | std::ios::out | std::ios::binary);
+        out.seekp(std::streamoff(offset));
+        out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+      }
+      s21::Obj result;
+      EXPECT_FALSE(
+          s21::MeshCache(dir.string(), 1 << 20, compress).Load(file, result));
+      EXPECT_EQ(result.vertexes, nullptr);
+    }
+  }
+
+  // a damaged entry is parsed over
+  s21::Obj parsed;
+  s21::LoadOptions options;
+  options.use_cache = true;
+  options.cache_dir = dir.string();
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, parsed, options));
+  EXPECT_EQ(*parsed.vertexes, *stored.vertexes);
+  fs::remove_all(dir);
+}
+
+TEST_F(ModelTest, open_test_unique_edges) {
+  s21::Obj result, cube;
+  s21::LoadOptions options;
+  options.unique_edges = true;
+  model_.ExecuteCommand(new s21::OpenFileCommand(
+      "./sources/tests/correct_sample.txt", result, options));
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/cube.obj", cube, options));
+  s21::facet expected_f{0, 1, 1, 2, 0, 2, 2, 3, 0, 3};
+
+  EXPECT_EQ(*result.facetes, expected_f);
+  EXPECT_EQ(cube.facetes->size(), 17u * 2);
+}
+
+TEST_F(ModelTest, open_test_parallel_dedup) {
+  namespace fs = std::filesystem;
+  auto file = (fs::temp_directory_path() / "s21_parallel_dedup.obj").string();
+  // enough edges and vertices for every thread to take a part, each vertex
+  // written twice and every other face starting in the second copy
+  const unsigned count = 530000;
+  {
+    std::ofstream out(file);
+    for (int copy = 0; copy < 2; ++copy) {
+      for (unsigned i = 0; i < count; ++i) {
+        out << "v " << i % 1000 << " " << i / 1000 << " " << i * 7 % 13
+            << "\n";
+      }
+    }
+    for (unsigned i = 0; i + 2 < count; ++i) {
+      const unsigned other = i % 2 ? count : 0;
+      out << "f " << i + 1 + other << " " << i + 2 << " " << i + 3 << "\n";
+    }
+  }
+  s21::Obj serial, parallel;
+  s21::LoadOptions options;
+  options.unique_edges = true;
+  options.threads = 1;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, serial, options));
+  options.threads = 4;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, parallel, options));
+  EXPECT_EQ(*parallel.facetes, *serial.facetes);
+  EXPECT_LT(serial.facetes->size(), 3u * 2 * (count - 2));
+
+  s21::Obj welded_serial, welded_parallel;
+  options.weld = true;
+  options.threads = 1;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, welded_serial, options));
+  options.threads = 4;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand(file, welded_parallel, options));
+  EXPECT_EQ(welded_serial.welded, count);
+  EXPECT_EQ(welded_parallel.welded, count);
+  EXPECT_EQ(*welded_parallel.vertexes, *welded_serial.vertexes);
+  EXPECT_EQ(*welded_parallel.facetes, *welded_serial.facetes);
+  EXPECT_LT(welded_serial.facetes->size(), serial.facetes->size());
+  fs::remove(file);
+}
+
+TEST_F(ModelTest, open_test_gzip) {
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() / "s21_gzip_test";
+  auto plain_file = (dir / "model.obj").string();
+  auto gzip_file = plain_file + ".gz";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::ifstream skull("./objects/skull.obj", std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(skull)),
+                   std::istreambuf_iterator<char>());
+  // larger than a block, so lines cross block boundaries
+  text = text + text + text;
+  std::ofstream(plain_file, std::ios::binary) << text;
+  // two concatenated members split in the middle of a line
+  for (auto [begin, mode] : {std::pair{std::size_t(0), "wb"},
+                             std::pair{text.size() / 2 + 7, "ab"}}) {
+    auto end = begin ? text.size() : text.size() / 2 + 7;
+    gzFile out = gzopen(gzip_file.c_str(), mode);
+    ASSERT_NE(out, nullptr);
+    gzwrite(out, text.data() + begin, unsigned(end - begin));
+    gzclose(out);
+  }
+
+  s21::Obj plain, unpacked;
+  s21::LoadOptions options;
+  options.threads = 1;
+  model_.ExecuteCommand(new s21::OpenFileCommand(plain_file, plain, options));
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand(gzip_file, unpacked, options));
+  EXPECT_EQ(*plain.vertexes, *unpacked.vertexes);
+  EXPECT_EQ(*plain.facetes, *unpacked.facetes);
+  EXPECT_EQ(plain.min, unpacked.min);
+  EXPECT_EQ(plain.max, unpacked.max);
+
+  fs::resize_file(gzip_file, fs::file_size(gzip_file) / 3);
+  s21::Obj truncated;
+  EXPECT_THROW(model_.ExecuteCommand(
+                   new s21::OpenFileCommand(gzip_file, truncated, options)),
+               std::runtime_error);
+  EXPECT_EQ(truncated.vertexes, nullptr);
+  fs::remove_all(dir);
+}
+
+TEST_F(ModelTest, pack_test) {
+  s21::Obj plain, packed;
+  s21::LoadOptions options;
+  model_.ExecuteCommand(new s21::OpenFileCommand(
+      "./sources/tests/correct_sample.txt", plain, options));
+  options.pack_indexes = true;
+  model_.ExecuteCommand(new s21::OpenFileCommand(
+      "./sources/tests/correct_sample.txt", packed, options));
+  EXPECT_EQ(packed.facetes, nullptr);
+  ASSERT_NE(packed.indexes, nullptr);
+  EXPECT_EQ(packed.indexes->width, 1u);
+  ASSERT_EQ(packed.indexes->size(), plain.facetes->size());
+  for (std::size_t i = 0; i < plain.facetes->size(); ++i) {
+    EXPECT_EQ(packed.indexes->at(i), (*plain.facetes)[i]);
+  }
+
+  const std::size_t count = 1 << 18;
+  s21::facet strip, scattered;
+  for (unsigned i = 0; i + 1 < count; ++i) {
+    strip.insert(strip.end(), {i, i + 1});
+    scattered.insert(scattered.end(), {i, unsigned(count - 1 - i)});
+  }
+  auto batched = s21::IndexBuffer::Pack(strip, count);
+  EXPECT_EQ(batched.width, 2u);
+  EXPECT_GT(batched.batches.size(), 1u);
+  for (const auto &batch : batched.batches) {
+    EXPECT_EQ(batch.first % 2, 0u);
+  }
+  auto wide = s21::IndexBuffer::Pack(scattered, count);
+  EXPECT_EQ(wide.width, 4u);
+  EXPECT_EQ(wide.batches.size(), 1u);
+  for (std::size_t i = 0; i < strip.size(); ++i) {
+    ASSERT_EQ(batched.at(i), strip[i]);
+    ASSERT_EQ(wide.at(i), scattered[i]);
+  }
+
+  // one line longer than 16 bits among short ones keeps 32-bit indices
+  s21::facet one_long;
+  for (unsigned i = 0; i + 1 < 200000; ++i) {
+    one_long.insert(one_long.end(), {i, i + 1});
+  }
+  one_long.insert(one_long.begin() + 100000, {0, 150000});
+  auto kept = s21::IndexBuffer::Pack(one_long, 200000);
+  EXPECT_EQ(kept.width, 4u);
+  EXPECT_EQ(kept.batches.size(), 1u);
+  for (std::size_t i = 0; i < one_long.size(); ++i) {
+    ASSERT_EQ(kept.at(i), one_long[i]);
+  }
+}
+
+TEST_F(ModelTest, quantize_test) {
+  s21::Obj plain, quantized;
+  s21::LoadOptions options;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", plain, options));
+  options.quantize = true;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", quantized, options));
+  EXPECT_EQ(quantized.vertexes, nullptr);
+  ASSERT_NE(quantized.quantized, nullptr);
+  auto &positions = *quantized.quantized;
+  ASSERT_EQ(positions.size(), plain.vertexes->size());
+  EXPECT_EQ(positions.offset, plain.bounds.lower);
+  float widest = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    EXPECT_EQ(positions.scale[axis],
+              plain.bounds.upper[axis] - plain.bounds.lower[axis]);
+    widest = std::max(widest, positions.scale[axis]);
+  }
+  // half a step of the widest axis plus float rounding
+  EXPECT_LE(positions.error, widest / 65535 * 0.51f);
+  EXPECT_GT(positions.error, 0);
+  for (std::size_t i = 0; i < positions.size(); ++i) {
+    auto error = std::fabs(positions.at(i) - (*plain.vertexes)[i]);
+    ASSERT_LE(error, positions.error);
+    // every axis keeps the precision of its own extent
+    ASSERT_LE(error, positions.scale[i % 3] / 65535 * 0.51f);
+  }
+}
+
+TEST_F(ModelTest, open_test_bad_index) {
+  namespace fs = std::filesystem;
+  auto file = (fs::temp_directory_path() / "s21_bad_index.obj").string();
+  std::ofstream(file) << "v 1 2 3\nv 4 5 6\nv 7 8 9\nf 1 2 3\n"
+                      << "# comment\nf -1 -2 -3\nf 3 2 4\nf 1 2 -4\n";
+  s21::Obj result;
+  try {
+    model_.ExecuteCommand(new s21::OpenFileCommand(file, result));
+    ADD_FAILURE() << "no exception";
+  } catch (std::runtime_error &e) {
+    EXPECT_STREQ(e.what(), "Face index out of range at line 7.");
+  }
+  EXPECT_EQ(result.vertexes, nullptr);
+
+  std::ofstream(file) << "v 1 2 3\nv 4 5 6\nv 7 8 9\nf 1 2 -4\n";
+  EXPECT_THROW(model_.ExecuteCommand(new s21::OpenFileCommand(file, result)),
+               std::runtime_error);
+  fs::remove(file);
+}
+
+TEST_F(ModelTest, bounds_test) {
+  s21::Obj result;
+  s21::LoadOptions options;
+  options.bounding_sphere = true;
+  model_.ExecuteCommand(new s21::OpenFileCommand(
+      "./sources/tests/correct_sample.txt", result, options));
+  std::array<float, 3> lower{1, -75.45, -342.85};
+  std::array<float, 3> upper{123.123, 456.321, 12.32};
+  for (int axis = 0; axis < 3; ++axis) {
+    EXPECT_FLOAT_EQ(result.bounds.lower[axis], lower[axis]);
+    EXPECT_FLOAT_EQ(result.bounds.upper[axis], upper[axis]);
+  }
+  EXPECT_FLOAT_EQ(result.min, -342.85);
+  EXPECT_FLOAT_EQ(result.max, 456.321);
+  auto center = result.bounds.Center();
+  float radius = 0;
+  for (std::size_t i = 0; i < result.vertexes->size(); i += 3) {
+    float dx = (*result.vertexes)[i] - center[0],
+          dy = (*result.vertexes)[i + 1] - center[1],
+          dz = (*result.vertexes)[i + 2] - center[2];
+    radius = std::max(radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+  }
+  EXPECT_FLOAT_EQ(result.bounds.radius, radius);
+
+  s21::Obj skull;
+  options.threads = 4;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", skull, options));
+  auto &vertexes = *skull.vertexes;
+  for (int axis = 0; axis < 3; ++axis) {
+    float low = vertexes[axis], high = vertexes[axis];
+    for (std::size_t i = axis; i < vertexes.size(); i += 3) {
+      low = std::min(low, vertexes[i]);
+      high = std::max(high, vertexes[i]);
+    }
+    EXPECT_EQ(skull.bounds.lower[axis], low);
+    EXPECT_EQ(skull.bounds.upper[axis], high);
+  }
+}
+
+TEST_F(ModelTest, groups_test) {
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() / "s21_groups_test";
+  auto file = (dir / "model.obj").string();
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::ofstream(file) << "v 0 0 0\nv 1 0 0\nv 0 2 0\nv 0 0 3\nf 1 2 3\n"
+                      << "g  body \nf 1 2 4\ng empty\no part\n"
+                      << "f 2 3 4\nf -3 -2 -1\n";
+  s21::Obj result, unique, cached;
+  s21::LoadOptions options;
+  options.threads = 4;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, result, options));
+  ASSERT_EQ(result.groups.size(), 3u);
+  std::array<const char *, 3> names{"default", "body", "part"};
+  std::array<std::size_t, 3> first{0, 6, 12}, count{6, 6, 12};
+  std::array<unsigned, 3> first_vertex{0, 0, 1}, vertex_count{3, 4, 3};
+  for (std::size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(result.groups[i].name, names[i]);
+    EXPECT_EQ(result.groups[i].first, first[i]);
+    EXPECT_EQ(result.groups[i].count, count[i]);
+    EXPECT_EQ(result.groups[i].first_vertex, first_vertex[i]);
+    EXPECT_EQ(result.groups[i].vertex_count, vertex_count[i]);
+  }
+  std::array<float, 3> lower{0, 0, 0}, upper{1, 2, 3};
+  EXPECT_EQ(result.groups[2].bounds.lower, lower);
+  EXPECT_EQ(result.groups[2].bounds.upper, upper);
+
+  options.unique_edges = true;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, unique, options));
+  ASSERT_EQ(unique.groups.size(), 3u);
+  std::size_t total = 0;
+  for (auto &group : unique.groups) {
+    EXPECT_EQ(group.first, total);
+    total += group.count;
+  }
+  EXPECT_EQ(total, unique.facetes->size());
+
+  s21::MeshCache(dir.string(), 1 << 20, false).Store(file, result);
+  ASSERT_TRUE(s21::MeshCache(dir.string(), 1 << 20, false).Load(file, cached));
+  ASSERT_EQ(cached.groups.size(), result.groups.size());
+  for (std::size_t i = 0; i < cached.groups.size(); ++i) {
+    EXPECT_EQ(cached.groups[i].name, result.groups[i].name);
+    EXPECT_EQ(cached.groups[i].first, result.groups[i].first);
+    EXPECT_EQ(cached.groups[i].count, result.groups[i].count);
+    EXPECT_EQ(cached.groups[i].bounds.upper, result.groups[i].bounds.upper);
+  }
+  fs::remove_all(dir);
+}
+
+TEST_F(ModelTest, open_test_weld) {
+  s21::Obj plain, welded, snapped;
+  s21::LoadOptions options;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", plain, options));
+  options.weld = true;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", welded, options));
+  options.weld_epsilon = 0.01f;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand("./objects/skull.obj", snapped, options));
+
+  EXPECT_GT(welded.welded, 0u);
+  EXPECT_GT(snapped.welded, welded.welded);
+  EXPECT_EQ(welded.vertexes->size() + 3 * welded.welded,
+            plain.vertexes->size());
+  ASSERT_EQ(welded.facetes->size(), plain.facetes->size());
+  for (std::size_t i = 0; i < plain.facetes->size(); ++i) {
+    for (unsigned j = 0; j < 3; ++j) {
+      EXPECT_EQ((*welded.vertexes)[3 * (*welded.facetes)[i] + j],
+                (*plain.vertexes)[3 * (*plain.facetes)[i] + j]);
+    }
+  }
+  EXPECT_EQ(welded.min, plain.min);
+  EXPECT_EQ(welded.max, plain.max);
+}
+
+TEST_F(ModelTest, open_test_weld_epsilon) {
+  namespace fs = std::filesystem;
+  auto file = (fs::temp_directory_path() / "s21_weld_epsilon.obj").string();
+  // the first two are 1e-7 apart on both sides of a cell boundary, the last
+  // one is closer to the fourth than to the first
+  std::ofstream(file) << "v -0.00000005 0 0\nv 0.00000005 0 0\nv 0.0099 0 0\n"
+                         "v 0.0199 0 0\nv 0.015 0 0\nf 1 2 3\nf 3 4 5\n";
+  s21::Obj welded;
+  s21::LoadOptions options;
+  options.weld = true;
+  options.weld_epsilon = 0.01f;
+  model_.ExecuteCommand(new s21::OpenFileCommand(file, welded, options));
+  fs::remove(file);
+
+  EXPECT_EQ(welded.welded, 3u);
+  EXPECT_EQ(*welded.vertexes, (s21::vertex{-0.00000005f, 0, 0, 0.0199f, 0, 0}));
+  EXPECT_EQ(*welded.facetes,
+            (s21::facet{0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0}));
+}
+
+TEST_F(ModelTest, open_test_binary_formats) {
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() / "s21_binary_test";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  const float corners[4][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+  auto write = [](std::ofstream &out, const auto &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  const std::string vertexes = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+  std::ofstream((dir / "quad.obj").string()) << vertexes + "f 1 2 3\nf 1 3 4\n";
+  std::ofstream((dir / "polygons.obj").string())
+      << vertexes + "f 1 2 3\nf 1 2 3 4\n";
+  // no extension, found by its size
+  auto stl_file = (dir / "quad.bin").string();
+  {
+    std::ofstream out(stl_file, std::ios::binary);
+    out << std::string(80, ' ');
+    write(out, std::uint32_t(2));
+    for (auto triangle : {std::array{0, 1, 2}, std::array{0, 2, 3}}) {
+      out << std::string(12, '\0');
+      for (int corner : triangle) write(out, corners[corner]);
+      write(out, std::uint16_t(0));
+    }
+  }
+  // the coordinates packed, then among other properties and out of order
+  const char *vertex_properties[] = {
+      "property float x\nproperty float y\nproperty float z\n",
+      "property uchar red\nproperty double z\nproperty float y\n"
+      "property float x\n"};
+  for (int layout = 0; layout < 2; ++layout) {
+    std::ofstream out((dir / ("quad" + std::to_string(layout) + ".ply")),
+                      std::ios::binary);
+    out << "ply\nformat binary_little_endian 1.0\ncomment test\n"
+           "element vertex 4\n"
+        << vertex_properties[layout]
+        << "element face 2\nproperty list uchar int vertex_indices\n"
+           "element edge 1\nproperty int vertex1\nproperty int vertex2\n"
+           "end_header\n";
+    for (const auto &corner : corners) {
+      if (layout) {
+        write(out, std::uint8_t(255));
+        write(out, double(corner[2]));
+        write(out, corner[1]);
+        write(out, corner[0]);
+      } else {
+        write(out, corner);
+      }
+    }
+    write(out, std::uint8_t(3));
+    for (int index : {0, 1, 2}) write(out, index);
+    write(out, std::uint8_t(4));
+    for (int index : {0, 1, 2, 3}) write(out, index);
+    for (int index : {0, 1}) write(out, index);
+  }
+
+  EXPECT_EQ(s21::MeshLoader::Find((dir / "quad.obj").string()), nullptr);
+  ASSERT_NE(s21::MeshLoader::Find(stl_file), nullptr);
+  EXPECT_STREQ(s21::MeshLoader::Find(stl_file)->Name(), "STL");
+  EXPECT_STREQ(s21::MeshLoader::Find("mesh.PLY", nullptr, 0, 0)->Name(),
+               "PLY");
+
+  s21::Obj obj, polygons, stl;
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand((dir / "quad.obj").string(), obj));
+  model_.ExecuteCommand(
+      new s21::OpenFileCommand((dir / "polygons.obj").string(), polygons));
+  model_.ExecuteCommand(new s21::OpenFileCommand(stl_file, stl));
+  // welded back to the shared corners, in the order they first appear
+  EXPECT_EQ(stl.welded, 2u);
+  EXPECT_EQ(*stl.vertexes, *obj.vertexes);
+  EXPECT_TRUE(std::equal(stl.facetes->begin(), stl.facetes->end(),
+                         obj.facetes->begin()));
+  EXPECT_EQ(stl.max, obj.max);
+  for (int layout = 0; layout < 2; ++layout) {
+    s21::Obj ply;
+    model_.ExecuteCommand(new s21::OpenFileCommand(
+        (dir / ("quad" + std::to_string(layout) + ".ply")).string(), ply));
+    EXPECT_EQ(*ply.vertexes, *polygons.vertexes);
+    EXPECT_EQ(*ply.facetes, *polygons.facetes);
+  }
+
+  s21::Obj bad;
+  std::ofstream((dir / "text.stl").string()) << "solid quad\nendsolid\n";
+  std::ofstream((dir / "text.ply").string())
+      << "ply\nformat ascii 1.0\nelement vertex 0\nend_header\n";
+  auto truncated = (dir / "quad0.ply").string();
+  fs::resize_file(truncated, fs::file_size(truncated) - 20);
+  for (auto name : {"text.stl", "text.ply", "quad0.ply"}) {
+    EXPECT_THROW(model_.ExecuteCommand(new s21::OpenFileCommand(
+                     (dir / name).string(), bad)),
+                 std::runtime_error);
+    EXPECT_EQ(bad.vertexes, nullptr);
+  }
+  fs::remove_all(dir);
+}
+
 TEST_F(ModelTest, open_test_1) {
   s21::Obj result;
   s21::Command *command = new s21::OpenFileCommand("not_exists.obj", result);
@@ -38,8 +833,81 @@ TEST_F(ModelTest, open_test_2) {
   EXPECT_THROW(model_.ExecuteCommand(command), std::runtime_error);
 }
 
+TEST_F(ModelTest, mat4_kernels_test) {
+  using Isa = s21::Mat4Kernels::Isa;
+  float values[16], other_values[16];
+  for (int i = 0; i < 16; ++i) {
+    values[i] = float((i * 37) % 11) / 3 - 1.5f;
+    other_values[i] = float((i * 13) % 7) / 2 - 1.25f;
+  }
+  const auto a = s21::Mat4::FromArray(values);
+  const auto b = s21::Mat4::FromArray(other_values);
+  // rotation, scale and translation, invertible
+  s21::Mat4 affine = s21::Mat4::Scale(2.5f);
+  affine(0, 1) = 0.6f;
+  affine(1, 0) = -0.8f;
+  affine(2, 1) = 0.3f;
+  affine = affine * s21::Mat4::Translate(3, -4, 7);
+  std::vector<s21::Vec4> points(9);
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    points[i] = s21::Vec4{{float(i), 1 - float(i), 0.5f * float(i), 1}};
+  }
+  auto near = [](const s21::Mat4 &m, const s21::Mat4 &expected) {
+    for (int i = 0; i < 16; ++i) {
+      EXPECT_NEAR(m.GetPointer()[i], expected.GetPointer()[i], 1e-5);
+    }
+  };
+
+  s21::Mat4 reference, inverse;
+  ASSERT_TRUE(s21::Mat4Kernels::AffineInverse(affine, reference, Isa::kScalar));
+  near(affine * reference, s21::Mat4::Identity());
+  for (auto isa : {Isa::kScalar, Isa::kSse, Isa::kAvx, Isa::kNeon}) {
+    if (!s21::Mat4Kernels::Supported(isa)) continue;
+    near(s21::Mat4Kernels::Multiply(a, b, isa), a * b);
+    EXPECT_EQ(s21::Mat4Kernels::Transpose(a, isa), a.Transpose());
+    ASSERT_TRUE(s21::Mat4Kernels::AffineInverse(affine, inverse, isa));
+    near(inverse, reference);
+    // singular, the result is left alone
+    EXPECT_FALSE(s21::Mat4Kernels::AffineInverse(s21::Mat4::Scale(0),
+                                                 inverse, isa));
+    near(inverse, reference);
+    // every count, odd ones leave a tail, and in place
+    for (std::size_t count = 0; count <= points.size(); ++count) {
+      auto moved = points;
+      s21::Mat4Kernels::Transform(a, moved.data(), moved.data(), count, isa);
+      for (std::size_t i = 0; i < points.size(); ++i) {
+        auto expected = i < count ? points[i] * a : points[i];
+        for (int j = 0; j < 4; ++j) EXPECT_NEAR(moved[i][j], expected[j], 1e-5);
+      }
+    }
+  }
+}
+
+TEST_F(ModelTest, matrix_mul_blocked_test) {
+  // ragged tiles and strips, more than one depth block and strip group
+  const int m = 70, k = 300, n = 530;
+  s21::S21Matrix a(m, k), b(k, n);
+  for (int i = 0; i < m; ++i) {
+    for (int p = 0; p < k; ++p) a(i, p) = float((i * 7 + p * 3) % 17) - 8;
+  }
+  for (int p = 0; p < k; ++p) {
+    for (int j = 0; j < n; ++j) b(p, j) = float((p * 5 + j) % 13) / 4 - 1.5f;
+  }
+  auto product = a * b;
+  ASSERT_EQ(product.GetRows(), m);
+  ASSERT_EQ(product.GetCols(), n);
+  for (int i = 0; i < m; ++i) {
+    for (int j = 0; j < n; ++j) {
+      double expected = 0;
+      for (int p = 0; p < k; ++p) expected += double(a(i, p)) * b(p, j);
+      // the operands are small integers and quarters, sums are exact
+      ASSERT_EQ(product(i, j), float(expected)) << i << " " << j;
+    }
+  }
+}
+
 TEST_F(ModelTest, get_test_0) {
-  float *result = nullptr;
+  s21::Mat4 result;
   float fov = (60.0f * M_PI) / 180, aspect = 600.0f / 800.0f, near = 1.0f,
         far = 100.0f;
   float expected[16] = {1 / (aspect * tanf(fov / 2)),
@@ -62,12 +930,12 @@ TEST_F(ModelTest, get_test_0) {
       new s21::GenPerspectiveCommand(fov, aspect, near, far, result);
   model_.ExecuteCommand(command);
   for (int i = 0; i < 16; ++i) {
-    EXPECT_NEAR(result[i], expected[i], 1e-3);
+    EXPECT_NEAR(result.GetPointer()[i], expected[i], 1e-3);
   }
 }
 
 TEST_F(ModelTest, get_test_1) {
-  float *result = nullptr;
+  s21::Mat4 result;
   float left = -1.0f, right = 1.0f, bottom = -1.0f, top = 1.0f, near = -1.0f,
         far = 100.0f;
   float expected[16] = {2.0f / (right - left),
@@ -90,13 +958,125 @@ TEST_F(ModelTest, get_test_1) {
       new s21::GenOrthoCommand(left, right, bottom, top, near, far, result);
   model_.ExecuteCommand(command);
   for (int i = 0; i < 16; ++i) {
-    EXPECT_NEAR(result[i], expected[i], 1e-3);
+    EXPECT_NEAR(result.GetPointer()[i], expected[i], 1e-3);
+  }
+}
+
+TEST_F(ModelTest, mat4_test) {
+  constexpr s21::Mat4 kMove = s21::Mat4::Translate(1, 2, 3);
+  constexpr s21::Mat4 kBoth = s21::Mat4::Scale(2) * kMove;
+  static_assert(s21::Mat4::Identity() * kMove == kMove);
+  static_assert(kBoth.Transpose().Transpose() == kBoth);
+  static_assert(s21::Vec4{{1, 1, 1, 1}} * kBoth == s21::Vec4{{3, 4, 5, 1}});
+  static_assert(alignof(s21::Mat4) == 16 && sizeof(s21::Mat4) == 64);
+
+  float values[16];
+  for (int i = 0; i < 16; ++i) values[i] = float(i * i % 7) - 2.5f;
+  auto mat = s21::Mat4::FromArray(values);
+  auto other = s21::Mat4::FromMatrix(s21::S21Matrix::Init4x4fv(values)) *
+               kBoth.Transpose();
+  // the same sums in the same order
+  auto expected = s21::S21Matrix::Init4x4fv(values) *
+                  kBoth.Transpose().ToMatrix();
+  EXPECT_EQ(s21::Mat4::FromMatrix(expected), other);
+  EXPECT_EQ(mat.Transpose().ToMatrix().GetPointer()[1], values[4]);
+  EXPECT_THROW(s21::Mat4::FromMatrix(s21::S21Matrix(3, 3)),
+               std::invalid_argument);
+}
+
+TEST_F(ModelTest, mat4_expr_test) {
+  using Isa = s21::Mat4Kernels::Isa;
+  using s21::Lazy;
+  float values[16];
+  for (int i = 0; i < 16; ++i) values[i] = float((i * 29) % 13) / 4 - 1.5f;
+  const auto model = s21::Mat4::FromArray(values);
+  const auto projection = s21::Mat4::Perspective(1.0f, 0.75f, 1, 100);
+  const auto view = s21::Mat4::Translate(0, 0, -1);
+  auto near = [](const s21::Mat4 &m, const s21::Mat4 &expected) {
+    for (int i = 0; i < 16; ++i) {
+      EXPECT_NEAR(m.GetPointer()[i], expected.GetPointer()[i], 1e-4);
+    }
+  };
+  auto mvp = Lazy(projection).Transpose() * Lazy(view).Transpose() *
+             Lazy(model);
+  static_assert(decltype(mvp)::kLinks == 3);
+
+  for (auto isa : {Isa::kScalar, Isa::kSse, Isa::kAvx, Isa::kNeon}) {
+    if (!s21::Mat4Kernels::Supported(isa)) continue;
+    near(s21::Evaluate(mvp, isa),
+         projection.Transpose() * view.Transpose() * model);
+    // transposes of products move to the leaves
+    near(s21::Evaluate((Lazy(projection) * Lazy(model)).Transpose(), isa),
+         (projection * model).Transpose());
+    near(s21::Evaluate(Lazy(model) * (Lazy(view) * Lazy(projection)), isa),
+         model * (view * projection));
+    EXPECT_EQ(s21::Evaluate(Lazy(model).Transpose().Transpose(), isa), model);
+  }
+
+  // a frame's MVP, as paintGL builds it
+  s21::Mat4 result;
+  const std::size_t before = allocations.load();
+  for (int frame = 0; frame < 100; ++frame) {
+    result = s21::Evaluate(Lazy(projection).Transpose() *
+                           Lazy(view).Transpose() * Lazy(model));
+  }
+  EXPECT_EQ(allocations.load(), before);
+  near(result, projection.Transpose() * view.Transpose() * model);
+}
+
+TEST_F(ModelTest, frame_test) {
+  // stand-ins for the widget's strategies, kept as members and switched
+  struct Pass {
+    virtual ~Pass() = default;
+    virtual void Render(const s21::Mat4 &mvp) = 0;
+  };
+  struct Recorder : Pass {
+    void Render(const s21::Mat4 &mvp) override {
+      last = mvp;
+      ++frames;
+    }
+    s21::Mat4 last;
+    int frames = 0;
+  };
+  Recorder lines, points;
+  Pass *current = &lines;
+  s21::Camera camera;
+  s21::Pose pose;
+  pose.Scale(0.5f);
+
+  // every step of paintGL: projection, pose to MVP, strategy selection
+  const std::size_t before = allocations.load();
+  for (int frame = 0; frame < 100; ++frame) {
+    camera.SetProjection(frame / 10 % 2, 0.75f);
+    pose.Rotate(0.01f, 0.02f, 0);
+    const s21::Mat4 mvp = camera.Mvp(pose);
+    current = &lines;
+    current->Render(mvp);
+    if (frame % 3 == 0) {
+      current = &points;
+      current->Render(mvp);
+    }
+  }
+  EXPECT_EQ(allocations.load(), before);
+  EXPECT_EQ(lines.frames, 100);
+  EXPECT_EQ(points.frames, 34);
+
+  // frame 99 is in a parallel run
+  EXPECT_EQ(camera.GetProjection(),
+            s21::Mat4::Ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 100.0f));
+  const auto model = pose.ToMat4();
+  const auto expected = camera.GetProjection().Transpose() *
+                        s21::Camera::kView.Transpose() * model;
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_NEAR(lines.last.GetPointer()[i], expected.GetPointer()[i], 1e-4);
   }
+  camera.SetProjection(false, 0.75f);
+  EXPECT_EQ(camera.GetProjection(),
+            s21::Mat4::Perspective(s21::Camera::kFov, 0.75f, 1, 100.0f));
 }
 
 TEST_F(ModelTest, transform_test_1_over_x) {
-  float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-                        0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  s21::Pose pose;
   float rotate[16] = {1.0f,        0.0f, 0.0f, 0.0f,       0.0f,      0.997564f,
                       -0.0697565f, 0.0f, 0.0f, 0.0697565f, 0.997564f, 0.0f,
                       0.0f,        0.0f, 0.0f, 1.0f};
@@ -105,16 +1085,16 @@ TEST_F(ModelTest, transform_test_1_over_x) {
   expected = s21::S21Matrix::Init4x4fv(rotate).Transpose() * expected;
 
   s21::Command *command = new s21::RotateCommand(
-      identity, std::vector<float>{4.0f * M_PI / 180.0f, 0.0f, 0.0f});
+      pose, std::vector<float>{4.0f * M_PI / 180.0f, 0.0f, 0.0f});
   model_.ExecuteCommand(command);
+  const auto identity = pose.ToMat4();
   for (int i = 0; i < 16; ++i) {
-    EXPECT_NEAR(identity[i], expected.GetPointer()[i], 1e-3);
+    EXPECT_NEAR(identity.GetPointer()[i], expected.GetPointer()[i], 1e-3);
   }
 }
 
 TEST_F(ModelTest, transform_test_1_over_y) {
-  float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-                        0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  s21::Pose pose;
   float rotate[16] = {0.997564f, 0.0f, 0.0697565f,  0.0f, 0.0f,      1.0f,
                       0.0f,      0.0f, -0.0697565f, 0.0f, 0.997564f, 0.0f,
                       0.0f,      0.0f, 0.0f,        1.0f};
@@ -123,17 +1103,17 @@ TEST_F(ModelTest, transform_test_1_over_y) {
   expected = s21::S21Matrix::Init4x4fv(rotate).Transpose() * expected;
 
   s21::Command *command = new s21::RotateCommand(
-      identity, std::vector<float>{0.0f, 4.0f * M_PI / 180.0f, 0.0f});
+      pose, std::vector<float>{0.0f, 4.0f * M_PI / 180.0f, 0.0f});
   model_.ExecuteCommand(command);
 
+  const auto identity = pose.ToMat4();
   for (int i = 0; i < 16; ++i) {
-    EXPECT_NEAR(identity[i], expected.GetPointer()[i], 1e-3);
+    EXPECT_NEAR(identity.GetPointer()[i], expected.GetPointer()[i], 1e-3);
   }
 }
 
 TEST_F(ModelTest, transform_test_1_over_z) {
-  float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-                        0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  s21::Pose pose;
   float rotate[16] = {0.997564f, -0.0697565f, 0.0f, 0.0f, 0.0697565f, 0.997564f,
                       0.0f,      0.0f,        0.0f, 0.0f, 1.0f,       0.0f,
                       0.0f,      0.0f,        0.0f, 1.0f};
@@ -142,16 +1122,16 @@ TEST_F(ModelTest, transform_test_1_over_z) {
   expected = s21::S21Matrix::Init4x4fv(rotate).Transpose() * expected;
 
   s21::Command *command = new s21::RotateCommand(
-      identity, std::vector<float>{0.0f, 0.0f, 4.0f * M_PI / 180.0f});
+      pose, std::vector<float>{0.0f, 0.0f, 4.0f * M_PI / 180.0f});
   model_.ExecuteCommand(command);
+  const auto identity = pose.ToMat4();
   for (int i = 0; i < 16; ++i) {
-    EXPECT_NEAR(identity[i], expected.GetPointer()[i], 1e-3);
+    EXPECT_NEAR(identity.GetPointer()[i], expected.GetPointer()[i], 1e-3);
   }
 }
 
 TEST_F(ModelTest, transform_test_2) {
-  float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0,  0.0f, 0.0f,
-                        0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  s21::Pose pose;
   float move[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f,   1.0,    0.0f, 0.0f,
                     0.0f, 0.0f, 1.0f, 0.0f, -5.21f, 1.034f, 0.0f, 1.0f};
 
@@ -159,26 +1139,82 @@ TEST_F(ModelTest, transform_test_2) {
   expected = s21::S21Matrix::Init4x4fv(move).Transpose() * expected;
 
   s21::Command *command = new s21::TranslateCommand(
-      identity, std::vector<float>{-5.21f, 1.034f, 0.0f});
+      pose, std::vector<float>{-5.21f, 1.034f, 0.0f});
   model_.ExecuteCommand(command);
+  const auto identity = pose.ToMat4();
   for (int i = 0; i < 16; ++i) {
-    EXPECT_NEAR(identity[i], expected.GetPointer()[i], 1e-3);
+    EXPECT_NEAR(identity.GetPointer()[i], expected.GetPointer()[i], 1e-3);
   }
 }
 
 TEST_F(ModelTest, transform_test_3) {
-  float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0,  0.0f, 0.0f,
-                        0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  s21::Pose pose;
   float scale[16] = {3.5f, 0.0f, 0.0f, 0.0f, 0.0f, 3.5f, 0.0f, 0.0f,
                      0.0f, 0.0f, 3.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
 
   s21::S21Matrix expected{s21::S21Matrix::CreateIdentity(4)};
   expected = s21::S21Matrix::Init4x4fv(scale) * expected;
 
-  s21::Command *command = new s21::ScaleCommand(identity, 3.5);
+  s21::Command *command = new s21::ScaleCommand(pose, 3.5);
   model_.ExecuteCommand(command);
+  const auto identity = pose.ToMat4();
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_NEAR(identity.GetPointer()[i], expected.GetPointer()[i], 1e-3);
+  }
+}
+
+TEST_F(ModelTest, pose_test) {
+  // the matrices RotateCommand, ScaleCommand and TranslateCommand used to
+  // multiply into the model matrix
+  auto euler = [](float x, float y, float z) {
+    s21::Mat4 rx = s21::Mat4::Identity(), ry = rx, rz = rx;
+    rx(1, 1) = rx(2, 2) = std::cos(x);
+    rx(2, 1) = std::sin(x);
+    rx(1, 2) = -rx(2, 1);
+    ry(0, 0) = ry(2, 2) = std::cos(y);
+    ry(0, 2) = std::sin(y);
+    ry(2, 0) = -ry(0, 2);
+    rz(0, 0) = rz(1, 1) = std::cos(z);
+    rz(1, 0) = std::sin(z);
+    rz(0, 1) = -rz(1, 0);
+    return (rx * ry * rz).Transpose();
+  };
+  s21::Pose pose;
+  auto expected = s21::Mat4::Identity();
+  for (int step = 0; step < 50; ++step) {
+    const float x = 0.03f * float(step % 7), y = -0.05f * float(step % 3),
+                z = step % 5 ? 0.0f : 0.2f;
+    pose.Rotate(x, y, z);
+    expected = euler(x, y, z) * expected;
+    if (step % 10 == 0) {
+      pose.Scale(1.1f);
+      expected = expected * s21::Mat4::Scale(1.1f);
+    }
+    if (step % 4 == 0) {
+      pose.Translate(0.5f, -0.25f, 0.125f);
+      expected = s21::Mat4::Translate(0.5f, -0.25f, 0.125f).Transpose() *
+                 expected;
+    }
+  }
+  const auto matrix = pose.ToMat4();
   for (int i = 0; i < 16; ++i) {
-    EXPECT_NEAR(identity[i], expected.GetPointer()[i], 1e-3);
+    EXPECT_NEAR(matrix.GetPointer()[i], expected.GetPointer()[i], 1e-4);
+  }
+
+  // a long drag leaves the rotation orthonormal
+  s21::Pose dragged;
+  dragged.Scale(2);
+  for (int step = 0; step < 1000000; ++step) {
+    dragged.Rotate(1e-3f, -2e-3f, 0.5e-3f);
+  }
+  EXPECT_NEAR(dragged.GetRotation().Norm2(), 1, 1e-5);
+  const auto rotation = dragged.ToMat4();
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      float dot = 0;
+      for (int k = 0; k < 3; ++k) dot += rotation(i, k) * rotation(j, k);
+      EXPECT_NEAR(dot, i == j ? 4 : 0, 1e-5);
+    }
   }
 }
 }  // namespace
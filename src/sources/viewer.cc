@@ -5,9 +5,13 @@
 #include "../include/viewer.h"
 
 #include <QColorDialog>
+#include <QElapsedTimer>
 #include <QFileDialog>
+#include <QHash>
 #include <QList>
+#include <QSignalBlocker>
 #include <QMessageBox>
+#include <QStatusBar>
 
 #include "../include/gif.h"
 #include "ui_viewer.h"
@@ -20,16 +24,46 @@ viewer::viewer(QWidget *parent) : QMainWindow(parent), ui(new Ui::viewer) {
   OpenConfigFile();
   SetUiFromConfig();
   screencast_timer = new QTimer;
+  progress_ = new QProgressBar(this);
+  progress_->setRange(0, 1000);
+  cancel_ = new QPushButton(tr("Cancel"), this);
+  quantize_ = new QCheckBox(tr("Compact positions"), this);
+  quantize_->setToolTip(tr("Store positions as 16-bit integers, applies to "
+                           "the next opened file"));
+  quantize_->setChecked(ui->open_gl->conf.quantize);
+  use_cache_ = new QCheckBox(tr("Cache meshes"), this);
+  use_cache_->setToolTip(tr("Reopen unchanged files from a binary copy of up "
+                            "to 256 MiB in the user cache directory"));
+  use_cache_->setChecked(ui->open_gl->conf.use_cache);
+  statusBar()->addPermanentWidget(progress_, 1);
+  statusBar()->addPermanentWidget(cancel_);
+  statusBar()->addPermanentWidget(quantize_);
+  statusBar()->addPermanentWidget(use_cache_);
+  ShowProgress(false);
+  groups_list_ = new QListWidget(this);
+  groups_dock_ = new QDockWidget(tr("Groups"), this);
+  groups_dock_->setWidget(groups_list_);
+  groups_dock_->hide();
+  addDockWidget(Qt::RightDockWidgetArea, groups_dock_);
+  connect(groups_list_, &QListWidget::itemChanged, this,
+          [this](QListWidgetItem *item) {
+            bool visible = item->checkState() == Qt::Checked;
+            for (auto group : groups_of_row_[groups_list_->row(item)]) {
+              ui->open_gl->SetGroupVisible(group, visible);
+            }
+            ui->open_gl->update();
+          });
+  connect(cancel_, &QPushButton::clicked, this, &viewer::CancelOpenSignal);
+  connect(quantize_, &QCheckBox::toggled, this,
+          [this](bool checked) { ui->open_gl->conf.quantize = checked; });
+  connect(use_cache_, &QCheckBox::toggled, this,
+          [this](bool checked) { ui->open_gl->conf.use_cache = checked; });
   connect(ui->open_gl, &OpenGLWidget::OpenFileSignal, this, &viewer::OpenFile);
   connect(ui->open_gl, &OpenGLWidget::RotateMatrix, this,
           &viewer::RotateMatrix);
   connect(ui->open_gl, &OpenGLWidget::TranslateMatrix, this,
           &viewer::TranslateMatrix);
   connect(ui->open_gl, &OpenGLWidget::ScaleMatrix, this, &viewer::ScaleMatrix);
-  connect(ui->open_gl, &OpenGLWidget::GetOrthoMatrix, this,
-          &viewer::GetOrthoMatrix);
-  connect(ui->open_gl, &OpenGLWidget::GetPerspectiveMatrix, this,
-          &viewer::GetPerspectiveMatrix);
 }
 
 viewer::~viewer() {
@@ -38,8 +72,9 @@ viewer::~viewer() {
 }
 
 void viewer::on_open_file_clicked() {
-  QString filename = QFileDialog::getOpenFileName(this, tr("Open .obj file"),
-                                                  "", tr(".obj (*.obj)"));
+  QString filename = QFileDialog::getOpenFileName(
+      this, tr("Open model"), "",
+      tr("Models (*.obj *.obj.gz *.obj.zst *.stl *.ply)"));
   OpenFile(filename);
 }
 
@@ -207,10 +242,46 @@ void viewer::screencast_timer_tick() {
 }
 
 void viewer::SetError(const std::string &message) {
-  error = true;
+  ShowProgress(false);
   ui->opened_file->setText(QString::fromStdString(message));
 }
 
+void viewer::SetProgress(std::size_t done, std::size_t total) {
+  if (total) {
+    progress_->setRange(0, 1000);
+    progress_->setValue(int(double(done) / double(total) * 1000));
+  } else {
+    progress_->setRange(0, 0);
+  }
+}
+
+void viewer::ShowProgress(bool visible) {
+  progress_->setValue(0);
+  progress_->setVisible(visible);
+  cancel_->setVisible(visible);
+}
+
+void viewer::SetGroups(const std::vector<Group> &groups) {
+  QSignalBlocker blocker(groups_list_);
+  groups_list_->clear();
+  groups_of_row_.clear();
+  QHash<QString, int> rows;
+  for (std::size_t i = 0; i < groups.size(); ++i) {
+    auto name = QString::fromStdString(groups[i].name);
+    auto row = rows.find(name);
+    if (row == rows.end()) {
+      row = rows.insert(name, groups_list_->count());
+      auto *item = new QListWidgetItem(name, groups_list_);
+      item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+      item->setCheckState(Qt::Checked);
+      groups_of_row_.emplace_back();
+    }
+    groups_of_row_[*row].push_back(i);
+  }
+  // a file without g/o statements has a single default group
+  groups_dock_->setVisible(groups.size() > 1);
+}
+
 void viewer::SetColor(const QString &name, const QColor &color) {
   int index = 2;
   if (name == "back_color") {
@@ -221,21 +292,59 @@ void viewer::SetColor(const QString &name, const QColor &color) {
   ui->open_gl->conf.colors[index] = color;
 }
 
-void viewer::SetResult(const viewer::obj &input) {
-  ui->edges_number->setText(QString::number(input.facetes->size() / 2));
-  ui->vertices_number->setText(QString::number(input.vertexes->size() / 3));
-  ui->open_gl->SetObj(input.vertexes, input.facetes, input.min, input.max);
+void viewer::SetResult(Obj input) {
+  ShowProgress(false);
+  ui->edges_number->setText(QString::number(input.indexes->size() / 2));
+  auto coordinates =
+      input.quantized ? input.quantized->size() : input.vertexes->size();
+  ui->vertices_number->setText(QString::number(coordinates / 3));
+  QStringList messages;
+  if (input.welded) {
+    messages << tr("%1 duplicate vertices welded")
+                    .arg(qulonglong(input.welded));
+  }
+  if (input.quantized) {
+    messages << tr("positions quantized, max error %1")
+                    .arg(double(input.quantized->error));
+  }
+  if (messages.isEmpty()) {
+    statusBar()->clearMessage();
+  } else {
+    statusBar()->showMessage(messages.join(", "));
+  }
+  SetGroups(input.groups);
+  auto timings = input.timings;
+  QElapsedTimer upload;
+  upload.start();
+  ui->open_gl->SetObj(std::move(input));
+  timings.upload = double(upload.nsecsElapsed()) / 1e9;
+  ShowTimings(timings);
+  ui->opened_file->setText(loading_file_);
+  ui->open_gl->conf.filename = loading_file_;
+  ui->open_gl->update();
 }
-void viewer::OpenFile(const QString &filename) {
-  error = false;
-  emit OpenFileSignal(filename);
-  if (!error) {
-    ui->opened_file->setText(filename);
-    ui->open_gl->conf.filename = filename;
-    ui->open_gl->update();
+void viewer::ShowTimings(const LoadTimings &timings) {
+  const std::pair<const char *, double> stages[] = {
+      {QT_TR_NOOP("read"), timings.read},
+      {QT_TR_NOOP("parse"), timings.parse},
+      {QT_TR_NOOP("waiting for reads"), timings.stall},
+      {QT_TR_NOOP("indices"), timings.resolve},
+      {QT_TR_NOOP("deduplication"), timings.dedup},
+      {QT_TR_NOOP("bounds"), timings.bounds},
+      {QT_TR_NOOP("packing"), timings.pack},
+      {QT_TR_NOOP("upload"), timings.upload},
+      {QT_TR_NOOP("total"), timings.total}};
+  QStringList lines;
+  for (const auto &[name, seconds] : stages) {
+    lines << tr("%1: %2 ms").arg(tr(name)).arg(seconds * 1000, 0, 'f', 1);
   }
+  statusBar()->setToolTip(lines.join("\n"));
 }
-void viewer::SetResultMatrix(float *result) {
-  ui->open_gl->SetResultMatrix(result);
+
+void viewer::OpenFile(const QString &filename) {
+  loading_file_ = filename;
+  ShowProgress(true);
+  emit OpenFileSignal(filename, ui->open_gl->conf.quantize,
+                      ui->open_gl->conf.use_cache);
 }
 }  // namespace s21
\ No newline at end of file